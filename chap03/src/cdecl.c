@@ -30,7 +30,11 @@
 
 #define PROGRAM_NAME ("cdecl")
 
+/* the token stack is the only memory needed, and it is taken from here */
+#define ARENA_SIZE (2 * BUMP_ALLOCATOR_ALIGN + sizeof(struct token_stack) + MAXTOKENLEN * sizeof(struct token))
+
 char **chunks, **curr;
+static char arena[ARENA_SIZE];
 
 static void helpAndLeave(int status);
 static void pexit(const char *fCall);
@@ -48,11 +52,13 @@ main(int argc, char *argv[]) {
 		helpAndLeave(EXIT_FAILURE);
 
 	struct token_stack *stack = NULL;
+	struct bump_allocator bump;
 
 	chunks = &argv[1]; /* skip program name */
 	curr = chunks;
 
-	if (stack_init(&stack) == -1)
+	bump_allocator_init(&bump, arena, sizeof(arena));
+	if (stack_init_with(&stack, &bump.base) == -1)
 		pexit("stack_init");
 
 	if (find_identifier(stack) == -1)
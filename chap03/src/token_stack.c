@@ -2,14 +2,24 @@
 
 int
 stack_init(struct token_stack **stack) {
-	*stack = malloc(sizeof(struct token_stack));
+	return stack_init_with(stack, NULL);
+}
+
+/* the stack and its tokens are taken from `alloc` */
+int
+stack_init_with(struct token_stack **stack, struct allocator *alloc) {
+	*stack = allocator_alloc(alloc, sizeof(struct token_stack));
 	if (!*stack)
 		return -1;
 	
+	(*stack)->alloc = alloc;
 	(*stack)->size = 0;
-	(*stack)->tokens = malloc(MAXTOKENLEN * sizeof(struct token));
-	if (!(*stack)->tokens)
+	(*stack)->tokens = allocator_alloc(alloc, MAXTOKENLEN * sizeof(struct token));
+	if (!(*stack)->tokens) {
+		allocator_release(alloc, *stack, sizeof(struct token_stack));
+		*stack = NULL;
 		return -1;
+	}
 
 	return 0;
 }
@@ -48,7 +58,7 @@ stack_destroy(struct token_stack *stack) {
 		return -1;
 	}
 
-	free(stack->tokens);
-	free(stack);
+	allocator_release(stack->alloc, stack->tokens, MAXTOKENLEN * sizeof(struct token));
+	allocator_release(stack->alloc, stack, sizeof(struct token_stack));
 	return 0;
 }
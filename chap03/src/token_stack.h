@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "allocator.h"
+
 #define MAXTOKENLEN (128)
 #define MAXTOKENS (256)
 
@@ -22,6 +24,7 @@ struct token {
 };
 
 struct token_stack {
+	struct allocator *alloc; /* of the stack itself; NULL for the system one */
 	struct token *tokens;
 	int size;
 };
@@ -29,6 +32,7 @@ struct token_stack {
 /* stack related utility functions: all of them return a nonnegative value on success
  * or -1 on error, with errno appropriately set */
 int stack_init(struct token_stack **stack);
+int stack_init_with(struct token_stack **stack, struct allocator *alloc);
 int stack_push(struct token_stack *stack, struct token *el);
 int stack_pop(struct token_stack *stack, struct token *el);
 int stack_destroy(struct token_stack *stack);
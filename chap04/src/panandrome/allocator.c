@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* rounds `n` up to the alignment suitable for any type */
+#define ALIGN_UP(n) (((n) + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1))
+
+static void *system_alloc(struct allocator *a, size_t size);
+static void system_release(struct allocator *a, void *p, size_t size);
+static void *counting_alloc(struct allocator *a, size_t size);
+static void counting_release(struct allocator *a, void *p, size_t size);
+static void *bump_alloc(struct allocator *a, size_t size);
+static void bump_release(struct allocator *a, void *p, size_t size);
+static void *pool_alloc(struct allocator *a, size_t size);
+static void pool_release(struct allocator *a, void *p, size_t size);
+
+struct allocator allocator_system = { system_alloc, system_release };
+
+void *
+allocator_alloc(struct allocator *a, size_t size)
+{
+	if (a == NULL)
+		a = &allocator_system;
+
+	return a->alloc(a, size);
+}
+
+void
+allocator_release(struct allocator *a, void *p, size_t size)
+{
+	if (p == NULL)
+		return;
+
+	if (a == NULL)
+		a = &allocator_system;
+
+	a->release(a, p, size);
+}
+
+void
+counting_allocator_init(struct counting_allocator *c, struct allocator *parent)
+{
+	c->base.alloc = counting_alloc;
+	c->base.release = counting_release;
+	c->parent = parent;
+	c->allocs = c->releases = c->failures = 0;
+	c->live = c->total = c->peak = 0;
+}
+
+void
+bump_allocator_init(struct bump_allocator *b, void *buf, size_t len)
+{
+	uintptr_t start = (uintptr_t) buf, aligned = ALIGN_UP(start);
+
+	b->base.alloc = bump_alloc;
+	b->base.release = bump_release;
+
+	/* the first block must be aligned as well */
+	b->buf = (char *) buf + (aligned - start);
+	b->len = len > aligned - start ? len - (aligned - start) : 0;
+	b->used = 0;
+}
+
+void
+bump_allocator_reset(struct bump_allocator *b)
+{
+	b->used = 0;
+}
+
+int
+pool_allocator_init(struct pool_allocator *p, struct allocator *parent, size_t object_size, long per_chunk)
+{
+	ErrorCase(p == NULL || object_size == 0 || per_chunk <= 0, EINVAL, -1);
+
+	p->base.alloc = pool_alloc;
+	p->base.release = pool_release;
+	p->parent = parent;
+	p->object_size = object_size;
+	p->per_chunk = per_chunk;
+	p->free_list = NULL;
+	p->chunks = NULL;
+	p->num_chunks = 0;
+
+	return 0;
+}
+
+int
+pool_allocator_destroy(struct pool_allocator *p)
+{
+	ErrorCase(p == NULL, EINVAL, -1);
+
+	size_t chunk_size = ALIGN_UP(sizeof(void *)) + p->per_chunk * ALIGN_UP(p->object_size);
+	void *chunk, *next;
+
+	for (chunk = p->chunks; chunk != NULL; chunk = next) {
+		next = *(void **) chunk;
+		allocator_release(p->parent, chunk, chunk_size);
+	}
+
+	p->free_list = NULL;
+	p->chunks = NULL;
+	p->num_chunks = 0;
+
+	return 0;
+}
+
+static void *
+system_alloc(struct allocator *a, size_t size)
+{
+	(void) a;
+	return malloc(size);
+}
+
+static void
+system_release(struct allocator *a, void *p, size_t size)
+{
+	(void) a;
+	(void) size;
+	free(p);
+}
+
+static void *
+counting_alloc(struct allocator *a, size_t size)
+{
+	struct counting_allocator *c = (struct counting_allocator *) a;
+	void *p;
+
+	if ((p = allocator_alloc(c->parent, size)) == NULL) {
+		++c->failures;
+		return NULL;
+	}
+
+	++c->allocs;
+	c->live += size;
+	c->total += size;
+	if (c->live > c->peak)
+		c->peak = c->live;
+
+	return p;
+}
+
+static void
+counting_release(struct allocator *a, void *p, size_t size)
+{
+	struct counting_allocator *c = (struct counting_allocator *) a;
+
+	allocator_release(c->parent, p, size);
+
+	++c->releases;
+	c->live -= size;
+}
+
+static void *
+bump_alloc(struct allocator *a, size_t size)
+{
+	struct bump_allocator *b = (struct bump_allocator *) a;
+	void *p;
+
+	size = ALIGN_UP(size);
+	ErrorCase(size > b->len - b->used, ENOMEM, NULL);
+
+	p = &(b->buf[b->used]);
+	b->used += size;
+
+	return p;
+}
+
+/* blocks are only released all at once, by `bump_allocator_reset` */
+static void
+bump_release(struct allocator *a, void *p, size_t size)
+{
+	(void) a;
+	(void) p;
+	(void) size;
+}
+
+static void *
+pool_alloc(struct allocator *a, size_t size)
+{
+	struct pool_allocator *p = (struct pool_allocator *) a;
+	size_t header = ALIGN_UP(sizeof(void *)), stride = ALIGN_UP(p->object_size);
+	char *chunk;
+	void *block;
+	long i;
+
+	if (size != p->object_size)
+		return allocator_alloc(p->parent, size);
+
+	/* a new chunk is only taken when every block is in use. Its blocks
+	 * are put on the free list in order, so that they are handed out in
+	 * the order they are laid out. */
+	if (p->free_list == NULL) {
+		chunk = allocator_alloc(p->parent, header + p->per_chunk * stride);
+		ErrorCase(chunk == NULL, errno, NULL);
+
+		*(void **) chunk = p->chunks;
+		p->chunks = chunk;
+		++p->num_chunks;
+
+		for (i = p->per_chunk - 1; i >= 0; --i) {
+			block = chunk + header + i * stride;
+			*(void **) block = p->free_list;
+			p->free_list = block;
+		}
+	}
+
+	block = p->free_list;
+	p->free_list = *(void **) block;
+
+	return block;
+}
+
+static void
+pool_release(struct allocator *a, void *block, size_t size)
+{
+	struct pool_allocator *p = (struct pool_allocator *) a;
+
+	if (size != p->object_size) {
+		allocator_release(p->parent, block, size);
+		return;
+	}
+
+	*(void **) block = p->free_list;
+	p->free_list = block;
+}
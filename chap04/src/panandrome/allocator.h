@@ -0,0 +1,103 @@
+/* allocator - pluggable memory allocators.
+ *
+ * Modules that allocate on their hot paths (e.g., one buffer per word added
+ * to a `word_list`) take a `struct allocator`, instead of calling `malloc(3)`
+ * directly. The size of each block is given back when it is released, so
+ * that allocators need no headers of their own. A NULL allocator stands for
+ * the system one.
+ *
+ * Besides the system allocator, this module provides:
+ *
+ * 	counting - forwards to another allocator, counting allocations and
+ * 	           bytes (live, total and peak), to measure allocation pressure.
+ * 	bump     - carves blocks out of a fixed buffer, and releases them all
+ * 	           at once. Individual blocks are never released.
+ * 	pool     - keeps released blocks of a fixed size on a free list, so
+ * 	           that once it is warm, allocating takes no heap traffic.
+ * 	           Blocks of other sizes are left to another allocator.
+ *
+ * None of them is thread safe: each one should be owned by a single thread.
+ *
+ * This is the only copy of the module: chap03's cdecl builds it from here
+ * for its token stack. */
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+
+struct allocator {
+	void *(*alloc)(struct allocator *a, size_t size);
+	void (*release)(struct allocator *a, void *p, size_t size);
+};
+
+/* `malloc(3)` and `free(3)` */
+extern struct allocator allocator_system;
+
+/* allocates `size` bytes from `a` (the system allocator if NULL).
+ *
+ * Returns the block, or NULL on error, with errno set */
+void *allocator_alloc(struct allocator *a, size_t size);
+
+/* releases a block of `size` bytes allocated from `a`. `p` may be NULL. */
+void allocator_release(struct allocator *a, void *p, size_t size);
+
+struct counting_allocator {
+	struct allocator base;
+	struct allocator *parent;
+
+	unsigned long allocs, releases, failures;
+	size_t live;  /* bytes allocated and not released yet */
+	size_t total; /* bytes ever allocated */
+	size_t peak;  /* largest value of `live` */
+};
+
+/* initializes a counting allocator on top of `parent` (the system allocator
+ * if NULL), with every counter at zero */
+void counting_allocator_init(struct counting_allocator *c, struct allocator *parent);
+
+struct bump_allocator {
+	struct allocator base;
+
+	char *buf;
+	size_t len;  /* of `buf` */
+	size_t used; /* bytes handed out since the last reset */
+};
+
+/* blocks are aligned for any type */
+#define BUMP_ALLOCATOR_ALIGN (sizeof(max_align_t))
+
+/* initializes a bump allocator that hands out the `len` bytes of `buf`,
+ * which is owned by the caller. Allocations fail with ENOMEM once it is
+ * exhausted. */
+void bump_allocator_init(struct bump_allocator *b, void *buf, size_t len);
+
+/* releases every block handed out so far */
+void bump_allocator_reset(struct bump_allocator *b);
+
+struct pool_allocator {
+	struct allocator base;
+	struct allocator *parent;
+
+	size_t object_size; /* of every block */
+	long per_chunk;     /* blocks taken from `parent` at once */
+
+	void *free_list; /* released blocks, linked through their first bytes */
+	void *chunks;    /* chunks taken from `parent`, linked the same way */
+	long num_chunks;
+};
+
+/* initializes a pool of blocks of `object_size` bytes, taken from `parent`
+ * (the system allocator if NULL) `per_chunk` blocks at a time. Allocations of
+ * any other size are forwarded to `parent`.
+ *
+ * Returns a positive number on success, -1 on error */
+int pool_allocator_init(struct pool_allocator *p, struct allocator *parent, size_t object_size, long per_chunk);
+
+/* gives every chunk back to the parent allocator. Blocks still in use are
+ * released as well. */
+int pool_allocator_destroy(struct pool_allocator *p);
+
+#endif /* ALLOCATOR_H */
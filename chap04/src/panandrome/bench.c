@@ -0,0 +1,609 @@
+/* bench.c - reproducible measurements of the word list and of the search.
+ *
+ * A synthetic nouns list is generated from a fixed seed: words are random
+ * strings, sorted and without repetitions, whose letters are drawn from a
+ * given distribution. The list is then used to measure, in order:
+ *
+ * 	load     - word_list_load of the list, written to a temporary file
+ * 	prepare_1 - word_list_prepare of the same file, with a single thread
+ * 	prepare  - word_list_prepare of the same file, with the given threads
+ * 	index    - word_list_index of the list
+ * 	save     - word_list_save of the indexed list, as a compiled dictionary
+ * 	open     - word_list_open of that dictionary
+ * 	prefix   - word_list_rlookup of words starting with a random prefix
+ * 	suffix   - word_list_rlookup of words ending with a random suffix
+ * 	prefix_q - the same prefixes, with word_list_prefix
+ * 	suffix_q - the same suffixes, with word_list_suffix
+ * 	prefix_u - the same prefixes, skipping the words marked as used (half
+ * 	           of the blocks, and a third of the other words) with
+ * 	           word_list_span_next, as the left lookups of the search do
+ * 	           with -u (right lookups walk suffix spans, which are not
+ * 	           ranges of positions: used words are only skipped one by one)
+ * 	dict_load   - word_dict_load of the list
+ * 	dict_get    - word_dict_get of random words
+ * 	dict_prefix - the same prefixes, with word_dict_prefix
+ * 	insert   - word_list_add_at in the middle of a growing list
+ * 	churn    - word_list_add_at and word_list_remove_at at the end of a list
+ * 	           whose words come from a (warmed up) pool allocator, as the
+ * 	           search does while stepping and rolling back
+ * 	generate - a full palindrome search, with a fixed seed
+ *
+ * For each of them, the throughput, latency percentiles (when operations are
+ * timed individually) and the number of allocations made are reported. The
+ * peak resident set size of the process is reported at the end.
+ *
+ * Usage:
+ *
+ * 	$ ./panandrome_bench [-n <words>] [-l <letters>] [-q <queries>] [-p <palindrome_size>] [-s <seed>]
+ * 	                     [-t <threads>] [-L]
+ *
+ * 	words - size of the generated nouns list. Defaults to 10000.
+ * 	letters - the letters words are made of; the more often a letter
+ * 	          appears, the more often it is used. Defaults to an
+ * 	          approximation of the English letter frequencies.
+ * 	queries - number of lookups and insertions to time. Defaults to 1000.
+ * 	palindrome_size - size of the generated palindrome. Defaults to 100.
+ * 	seed - seed of the random number generator. Defaults to 1.
+ * 	threads - threads of word_list_prepare. Defaults to one per online
+ * 	          processor.
+ * 	-L - only measure the loading of the list (load and prepare), which
+ * 	     needs no closure graph: for lists too large to build one.
+ *
+ * Allocations are counted by wrapping malloc(3) and friends at link time
+ * (see the Makefile), so only allocations made by the measured code count.
+ * The ones of churn and generate are instead those their pool takes from the
+ * heap (the closure graph and the cache of generate aside), as counted by a
+ * counting allocator underneath it, whose peak of live bytes is reported as
+ * well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "word_list.h"
+#include "word_dict.h"
+#include "state_graph.h"
+#include "candidate_cache.h"
+#include "search.h"
+
+#define BENCH_MINLEN (4)
+#define BENCH_MAXLEN (12)
+
+static char *progname = "panandrome_bench";
+
+static atomic_ulong allocations;
+static atomic_ulong allocated_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&allocated_bytes, size, memory_order_relaxed);
+	return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&allocated_bytes, nmemb * size, memory_order_relaxed);
+	return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+	size_t old = ptr != NULL ? malloc_usable_size(ptr) : 0;
+
+	/* only growth counts as newly allocated memory */
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&allocated_bytes, size > old ? size - old : 0, memory_order_relaxed);
+	return __real_realloc(ptr, size);
+}
+
+/* a measured run: `n` operations, and the latency of each of them, if they
+ * were timed individually */
+struct run {
+	const char *name;
+	long n;
+	double seconds;
+	double *latencies;
+	unsigned long allocations, bytes;
+	struct counting_allocator *counter; /* counts allocations instead of the wrappers, if set */
+};
+
+static void usage(void);
+static void pexit(const char *fname);
+static double now(void);
+static void begin(struct run *r, const char *name, long n, bool timed);
+static void begin_counted(struct run *r, const char *name, long n, bool timed, struct counting_allocator *c);
+static void end(struct run *r);
+static void report(struct run *r);
+static int compare_doubles(const void *a, const void *b);
+static int compare_words(const void *a, const void *b);
+static char **generate(long *n, const char *letters, unsigned int *seed);
+static bool prefix_selector(const char *word, char *article, void *data);
+static bool suffix_selector(const char *word, char *article, void *data);
+
+int
+main(int argc, char *argv[])
+{
+	long n = 10000, queries = 1000, size = 100, threads = 0, i;
+	const char *letters = "aaaaaaaabbcccddddeeeeeeeeeeeeffgghhhhhhiiiiiiijkllllmmmnnnnnnnooooooooppqrrrrrrsssssstttttttttuuuvwwxyyz";
+	unsigned int seed = 1, qseed;
+	char path[] = "/tmp/panandrome-bench-XXXXXX";
+	char buffer[WORD_LIST_LARGEST_NOUN], article[3], affix[4];
+	struct word_list nouns, list, mapped, prepared;
+	struct word_list_prep prep;
+	struct pool_allocator pool;
+	struct counting_allocator counter;
+	struct word_list_span span;
+	uint64_t *used;
+	long ids[WORD_LIST_LOOKUP_RSET], num_ids, id, cursor;
+	struct word_dict dict;
+	struct state_graph graph;
+	struct candidate_cache cache;
+	struct search search;
+	struct rusage usage_info;
+	struct run r;
+	char **words, *word;
+	double t;
+	FILE *f;
+	double single;
+	bool load_only = false;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "l:n:p:q:s:t:L")) != -1) {
+		switch (opt) {
+			case 'l':
+				letters = optarg;
+				break;
+			case 'n':
+				n = strtol(optarg, NULL, 10);
+				break;
+			case 'p':
+				size = strtol(optarg, NULL, 10);
+				break;
+			case 'q':
+				queries = strtol(optarg, NULL, 10);
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				threads = strtol(optarg, NULL, 10);
+				break;
+			case 'L':
+				load_only = true;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (n <= 0 || queries <= 0 || size <= 0 || threads < 0 || strlen(letters) == 0)
+		usage();
+
+	printf("# words=%ld queries=%ld palindrome_size=%ld seed=%u\n", n, queries, size, seed);
+
+	/* the nouns list, written to a file so that it can be loaded */
+	t = now();
+	words = generate(&n, letters, &seed);
+	if ((fd = mkstemp(path)) == -1 || (f = fdopen(fd, "w+")) == NULL)
+		pexit("mkstemp");
+	for (i = 0; i < n; ++i)
+		fprintf(f, "%s\n", words[i]);
+	fflush(f);
+	printf("# generated %ld words in %.3fs\n", n, now() - t);
+	printf("%-11s %10s %10s %14s %10s %10s %10s %10s %12s %14s\n",
+			"benchmark", "ops", "seconds", "ops/s", "p50(us)", "p90(us)", "p99(us)", "max(us)", "allocs", "bytes");
+
+	begin(&r, "load", n, false);
+	rewind(f);
+	if (word_list_init(&nouns, n) == -1 || word_list_load(&nouns, f) == -1)
+		pexit("word_list_load");
+	end(&r);
+	report(&r);
+
+	/* the same file, through the parallel pipeline that panandrome uses
+	 * for text lists: first on a single thread, to tell how it scales */
+	begin(&r, "prepare_1", n, false);
+	if (word_list_prepare(&prepared, path, 1, &prep) == -1)
+		pexit("word_list_prepare");
+	end(&r);
+	report(&r);
+	single = r.seconds;
+	word_list_destroy(&prepared);
+
+	if (threads == 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	begin(&r, "prepare", n, false);
+	if (word_list_prepare(&prepared, path, threads, &prep) == -1)
+		pexit("word_list_prepare");
+	end(&r);
+	report(&r);
+	printf("# prepare: threads=%ld speedup=%.2f lines=%ld rejected=%ld duplicates=%ld sorted=%s\n",
+			threads, r.seconds > 0 ? single / r.seconds : 0.0, prep.lines, prep.rejected, prep.duplicates,
+			prep.sorted ? "yes" : "no");
+	word_list_destroy(&prepared);
+
+	if (load_only) {
+		fclose(f);
+		unlink(path);
+		word_list_destroy(&nouns);
+		goto done;
+	}
+
+	begin(&r, "dict_load", n, false);
+	rewind(f);
+	if (word_dict_init(&dict) == -1 || word_dict_load(&dict, f) == -1)
+		pexit("word_dict_load");
+	end(&r);
+	report(&r);
+
+	fclose(f);
+	unlink(path);
+
+	begin(&r, "index", n, false);
+	if (word_list_index(&nouns) == -1)
+		pexit("word_list_index");
+	end(&r);
+	report(&r);
+
+	/* the compiled dictionary is written where the text list was */
+	begin(&r, "save", n, false);
+	if (word_list_save(&nouns, path) == -1)
+		pexit("word_list_save");
+	end(&r);
+	report(&r);
+
+	begin(&r, "open", n, false);
+	if (word_list_open(&mapped, path) == -1)
+		pexit("word_list_open");
+	end(&r);
+	report(&r);
+
+	word_list_destroy(&mapped);
+	unlink(path);
+
+	/* lookups of random prefixes and suffixes of existing words, so that
+	 * there is always at least one match */
+	qseed = seed;
+	begin(&r, "prefix", queries, true);
+	for (i = 0; i < queries; ++i) {
+		snprintf(affix, sizeof(affix), "%.2s", words[rand_r(&qseed) % n]);
+		t = now();
+		word_list_rlookup(&nouns, prefix_selector, affix, &qseed, buffer, article);
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	begin(&r, "suffix", queries, true);
+	for (i = 0; i < queries; ++i) {
+		word = words[rand_r(&qseed) % n];
+		snprintf(affix, sizeof(affix), "%s", &(word[strlen(word) - 2]));
+		t = now();
+		word_list_rlookup(&nouns, suffix_selector, affix, &qseed, buffer, article);
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	/* the same queries, through the indexes: a random match is picked, as
+	 * word_list_rlookup does */
+	qseed = seed;
+	begin(&r, "prefix_q", queries, true);
+	for (i = 0; i < queries; ++i) {
+		snprintf(affix, sizeof(affix), "%.2s", words[rand_r(&qseed) % n]);
+		t = now();
+		word_list_prefix(&nouns, affix, &span);
+		if (span.count > 0)
+			snprintf(buffer, sizeof(buffer), "%s", WORD_LIST_WORD(&nouns, WORD_LIST_SPAN_ID(&span, rand_r(&qseed) % span.count)));
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	begin(&r, "suffix_q", queries, true);
+	for (i = 0; i < queries; ++i) {
+		word = words[rand_r(&qseed) % n];
+		snprintf(affix, sizeof(affix), "%s", &(word[strlen(word) - 2]));
+		t = now();
+		word_list_suffix(&nouns, affix, &span);
+		if (span.count > 0)
+			snprintf(buffer, sizeof(buffer), "%s", WORD_LIST_WORD(&nouns, WORD_LIST_SPAN_ID(&span, rand_r(&qseed) % span.count)));
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	if ((used = calloc(WORD_LIST_BLOCKS(n), sizeof(uint64_t))) == NULL)
+		pexit("calloc");
+	for (i = 0; i < n; ++i)
+		if ((i / 64) % 2 == 0 || i % 3 == 0)
+			WORD_LIST_BIT_SET(used, i);
+
+	qseed = seed;
+	begin(&r, "prefix_u", queries, true);
+	for (i = 0; i < queries; ++i) {
+		snprintf(affix, sizeof(affix), "%.2s", words[rand_r(&qseed) % n]);
+		t = now();
+		word_list_prefix(&nouns, affix, &span);
+		for (num_ids = cursor = 0; num_ids < WORD_LIST_LOOKUP_RSET &&
+				(id = word_list_span_next(&span, used, &cursor)) != -1; )
+			ids[num_ids++] = id;
+		if (num_ids > 0)
+			snprintf(buffer, sizeof(buffer), "%s", WORD_LIST_WORD(&nouns, ids[rand_r(&qseed) % num_ids]));
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+	free(used);
+
+	/* the compressed dictionary: random access, and prefix queries */
+	begin(&r, "dict_get", queries, true);
+	for (i = 0; i < queries; ++i) {
+		t = now();
+		word_dict_get(&dict, rand_r(&qseed) % n, buffer);
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	qseed = seed;
+	begin(&r, "dict_prefix", queries, true);
+	for (i = 0; i < queries; ++i) {
+		snprintf(affix, sizeof(affix), "%.2s", words[rand_r(&qseed) % n]);
+		t = now();
+		word_dict_prefix(&dict, affix, &span);
+		if (span.count > 0)
+			word_dict_get(&dict, span.first + rand_r(&qseed) % span.count, buffer);
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+
+	printf("# memory: word_list=%ldB word_dict=%zuB\n",
+			nouns.num_words * (long) (WORD_LIST_LARGEST_NOUN + sizeof(char *)), word_dict_memory(&dict));
+	word_dict_destroy(&dict);
+
+	/* insertions at the middle of a list, as the search does */
+	if (word_list_init(&list, queries) == -1)
+		pexit("word_list_init");
+	begin(&r, "insert", queries, true);
+	for (i = 0; i < queries; ++i) {
+		t = now();
+		if (word_list_add_at(&list, words[rand_r(&qseed) % n], list.num_words / 2) == -1)
+			pexit("word_list_add_at");
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+	word_list_destroy(&list);
+
+	/* the pool only takes from the heap while the list grows beyond what
+	 * it has seen before */
+	counting_allocator_init(&counter, NULL);
+	if (pool_allocator_init(&pool, &counter.base, WORD_LIST_LARGEST_NOUN, SEARCH_POOL_CHUNK) == -1 ||
+			word_list_init_with(&list, queries, &pool.base) == -1)
+		pexit("word_list_init_with");
+	for (i = 0; i < queries; ++i)
+		word_list_append(&list, words[i % n]);
+	while (list.num_words > 0)
+		word_list_remove_at(&list, list.num_words - 1);
+
+	begin_counted(&r, "churn", queries, true, &counter);
+	for (i = 0; i < queries; ++i) {
+		t = now();
+		if (word_list_add_at(&list, words[rand_r(&qseed) % n], list.num_words) == -1 ||
+				(rand_r(&qseed) % 2 == 0 && word_list_remove_at(&list, list.num_words - 1) == -1))
+			pexit("word_list_add_at");
+		r.latencies[i] = now() - t;
+	}
+	end(&r);
+	report(&r);
+	word_list_destroy(&list);
+	pool_allocator_destroy(&pool);
+	printf("# churn: peak=%zuB live=%zuB\n", counter.peak, counter.live);
+
+	/* a full search, pruned and cached as with `panandrome -g` */
+	counting_allocator_init(&counter, NULL);
+	begin_counted(&r, "generate", size, false, &counter);
+	if (state_graph_build(&graph, &nouns, STATE_GRAPH_MAXLEN) == -1 ||
+			candidate_cache_init(&cache, CANDIDATE_CACHE_ENTRIES) == -1 ||
+			search_init_with(&search, &nouns, &graph, &cache, size, seed, &counter.base) == -1)
+		pexit("search_init");
+	if (search_run(&search, NULL) == -1)
+		fprintf(stderr, "%s: no palindrome found\n", progname);
+	end(&r);
+	r.n = search.total;
+	report(&r);
+	printf("# generate: states=%ld lookups=%lu rollbacks=%lu words_added=%lu\n", graph.num_nodes,
+			atomic_load(&search.counters.lookups), atomic_load(&search.counters.rollbacks),
+			atomic_load(&search.counters.words_added));
+
+	search_destroy(&search);
+	printf("# generate: peak=%zuB live=%zuB\n", counter.peak, counter.live);
+	candidate_cache_destroy(&cache);
+	state_graph_destroy(&graph);
+	word_list_destroy(&nouns);
+
+done:
+	for (i = 0; i < n; ++i)
+		free(words[i]);
+	free(words);
+
+	getrusage(RUSAGE_SELF, &usage_info);
+	printf("# peak_rss=%ldKiB\n", usage_info.ru_maxrss);
+
+	exit(EXIT_SUCCESS);
+}
+
+static bool
+prefix_selector(const char *word, char *article, void *data)
+{
+	const char *prefix = data;
+	(void) article;
+
+	return strncmp(word, prefix, strlen(prefix)) == 0;
+}
+
+static bool
+suffix_selector(const char *word, char *article, void *data)
+{
+	const char *suffix = data;
+	size_t len = strlen(word), suffix_len = strlen(suffix);
+	(void) article;
+
+	return len >= suffix_len && strcmp(&(word[len - suffix_len]), suffix) == 0;
+}
+
+/* generates `n` different words, sorted, with letters taken at random from
+ * `letters`. If there are not that many different words to be made of the
+ * given letters, `n` is updated to the number of words generated. */
+static char **
+generate(long *n, const char *letters, unsigned int *seed)
+{
+	long count = 0, previous = -1, i, j, len;
+	size_t nletters = strlen(letters);
+	char **words = malloc(*n * sizeof(char *));
+
+	if (words == NULL)
+		pexit("malloc");
+
+	/* repeated words are only known after sorting: keep generating
+	 * until there are enough different ones */
+	while (count < *n && count > previous) {
+		for (i = count; i < *n; ++i) {
+			len = BENCH_MINLEN + rand_r(seed) % (BENCH_MAXLEN - BENCH_MINLEN + 1);
+			if ((words[i] = malloc(len + 1)) == NULL)
+				pexit("malloc");
+
+			for (j = 0; j < len; ++j)
+				words[i][j] = letters[rand_r(seed) % nletters];
+			words[i][len] = '\0';
+		}
+
+		qsort(words, *n, sizeof(char *), compare_words);
+
+		for (i = j = 1; i < *n; ++i) {
+			if (strcmp(words[i], words[j - 1]) == 0)
+				free(words[i]);
+			else
+				words[j++] = words[i];
+		}
+
+		/* a round with no new words means the alphabet is (nearly)
+		 * exhausted: give up generating more */
+		previous = count;
+		count = j;
+	}
+
+	*n = count;
+	return words;
+}
+
+static void
+begin(struct run *r, const char *name, long n, bool timed)
+{
+	r->name = name;
+	r->n = n;
+	r->latencies = NULL;
+	if (timed && (r->latencies = __real_malloc(n * sizeof(double))) == NULL)
+		pexit("malloc");
+
+	r->counter = NULL;
+	r->allocations = atomic_load(&allocations);
+	r->bytes = atomic_load(&allocated_bytes);
+	r->seconds = now();
+}
+
+/* same as `begin`, but allocations are the ones made through `c` */
+static void
+begin_counted(struct run *r, const char *name, long n, bool timed, struct counting_allocator *c)
+{
+	begin(r, name, n, timed);
+	r->counter = c;
+	r->allocations = c->allocs;
+	r->bytes = c->total;
+}
+
+static void
+end(struct run *r)
+{
+	r->seconds = now() - r->seconds;
+	if (r->counter != NULL) {
+		r->allocations = r->counter->allocs - r->allocations;
+		r->bytes = r->counter->total - r->bytes;
+	} else {
+		r->allocations = atomic_load(&allocations) - r->allocations;
+		r->bytes = atomic_load(&allocated_bytes) - r->bytes;
+	}
+}
+
+static void
+report(struct run *r)
+{
+	printf("%-11s %10ld %10.4f %14.1f ", r->name, r->n, r->seconds, r->seconds > 0 ? r->n / r->seconds : 0.0);
+
+	if (r->latencies != NULL) {
+		qsort(r->latencies, r->n, sizeof(double), compare_doubles);
+		printf("%10.2f %10.2f %10.2f %10.2f ", r->latencies[r->n / 2] * 1e6, r->latencies[r->n * 9 / 10] * 1e6,
+				r->latencies[r->n * 99 / 100] * 1e6, r->latencies[r->n - 1] * 1e6);
+		free(r->latencies);
+	} else
+		printf("%10s %10s %10s %10s ", "-", "-", "-", "-");
+
+	printf("%12lu %14lu\n", r->allocations, r->bytes);
+	fflush(stdout);
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static int
+compare_words(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: %s [-n <words>] [-l <letters>] [-q <queries>] [-p <palindrome_size>] [-s <seed>] [-t <threads>] [-L]\n",
+			progname);
+	exit(EXIT_FAILURE);
+}
+
+static void
+pexit(const char *fname)
+{
+	perror(fname);
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,112 @@
+#include "candidate_cache.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+static struct candidate_entry *entry_for(struct candidate_cache *c, const char *key);
+static void make_key(char *key, const char *state, enum palindrome_direction direction);
+
+int
+candidate_cache_init(struct candidate_cache *c, long size)
+{
+	ErrorCase(c == NULL, EINVAL, -1);
+	ErrorCase(size <= 0 || size > CANDIDATE_CACHE_MAX_ENTRIES, EINVAL, -1);
+
+	/* the bound above keeps the doubling from overflowing */
+	c->size = 1;
+	while (c->size < size)
+		c->size *= 2;
+
+	c->entries = calloc(c->size, sizeof(struct candidate_entry));
+	ErrorCase(c->entries == NULL, errno, -1);
+
+	atomic_init(&c->hits, 0);
+	atomic_init(&c->misses, 0);
+	atomic_init(&c->evictions, 0);
+
+	return 0;
+}
+
+struct candidate_entry *
+candidate_cache_get(struct candidate_cache *c, const char *state, enum palindrome_direction direction)
+{
+	char key[WORD_LIST_LARGEST_NOUN + 4];
+	struct candidate_entry *e;
+
+	make_key(key, state, direction);
+	e = entry_for(c, key);
+
+	if (strcmp(e->key, key) == 0) {
+		METRICS_INC(c, hits);
+		return e;
+	}
+
+	METRICS_INC(c, misses);
+	return NULL;
+}
+
+struct candidate_entry *
+candidate_cache_put(struct candidate_cache *c, const char *state, enum palindrome_direction direction,
+		const long *ids, long num_ids, bool complete)
+{
+	char key[WORD_LIST_LARGEST_NOUN + 4];
+	struct candidate_entry *e;
+
+	make_key(key, state, direction);
+	e = entry_for(c, key);
+
+	if (e->key[0] != '\0' && strcmp(e->key, key) != 0)
+		METRICS_INC(c, evictions);
+
+	strncpy(e->key, key, sizeof(e->key));
+	memcpy(e->ids, ids, num_ids * sizeof(long));
+	e->num_ids = num_ids;
+	e->complete = complete;
+
+	return e;
+}
+
+void
+candidate_cache_clear(struct candidate_cache *c)
+{
+	long i;
+
+	for (i = 0; i < c->size; ++i)
+		c->entries[i].key[0] = '\0';
+}
+
+int
+candidate_cache_destroy(struct candidate_cache *c)
+{
+	ErrorCase(c == NULL, EINVAL, -1);
+
+	free(c->entries);
+	c->entries = NULL;
+	c->size = 0;
+
+	return 0;
+}
+
+/* FNV-1a of the key selects the only entry the key can be at */
+static struct candidate_entry *
+entry_for(struct candidate_cache *c, const char *key)
+{
+	unsigned long h = 14695981039346656037UL;
+
+	while (*key) {
+		h ^= (unsigned char) *key++;
+		h *= 1099511628211UL;
+	}
+
+	return &(c->entries[h & (c->size - 1)]);
+}
+
+static void
+make_key(char *key, const char *state, enum palindrome_direction direction)
+{
+	snprintf(key, WORD_LIST_LARGEST_NOUN + 4, "%c%s", direction == LEFT ? '<' : '>', state);
+}
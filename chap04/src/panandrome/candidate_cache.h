@@ -0,0 +1,66 @@
+/* candidate_cache - remembers which words fit a given state.
+ *
+ * The same short states ("a", "na", "aca"...) show up over and over during a
+ * search, and the words that fit each of them never change. This cache keeps
+ * the list of candidates (word positions in the dictionary) found the first
+ * time a state is looked up in a given direction, so that later visits can
+ * pick a word from it directly instead of scanning the dictionary again.
+ *
+ * The cache has a fixed number of entries and is direct-mapped: a new state
+ * evicts whatever state was using the same entry before. It is not thread
+ * safe: each search should have its own. */
+
+#ifndef CANDIDATE_CACHE_H
+#define CANDIDATE_CACHE_H
+
+#include "word_list.h"
+#include "state_graph.h"
+#include "metrics.h"
+
+#ifndef CANDIDATE_CACHE_ENTRIES
+#  define CANDIDATE_CACHE_ENTRIES (1024)
+#endif
+
+/* largest cache allowed (a power of 2): each entry takes close to 1KB */
+#ifndef CANDIDATE_CACHE_MAX_ENTRIES
+#  define CANDIDATE_CACHE_MAX_ENTRIES (1L << 20)
+#endif
+
+struct candidate_entry {
+	char key[WORD_LIST_LARGEST_NOUN + 4]; /* direction and state; empty if unused */
+	long num_ids;
+	long ids[WORD_LIST_LOOKUP_RSET];
+	bool complete; /* whether `ids` holds every word that fits the state */
+};
+
+struct candidate_cache {
+	long size; /* number of entries, a power of 2 */
+	struct candidate_entry *entries;
+
+	atomic_ulong hits, misses, evictions; /* see metrics.h */
+};
+
+/* initializes a cache with room for `size` states. `size` is rounded up to
+ * a power of 2, and must not exceed CANDIDATE_CACHE_MAX_ENTRIES.
+ *
+ * Returns a positive number on success, -1 on error */
+int candidate_cache_init(struct candidate_cache *c, long size);
+
+/* returns the cached candidates for `state` in `direction`, or NULL if they
+ * are not known. Updates the hit/miss counters. */
+struct candidate_entry *candidate_cache_get(struct candidate_cache *c, const char *state, enum palindrome_direction direction);
+
+/* stores the `num_ids` candidates in `ids` for `state` in `direction`, which
+ * are every candidate there is if `complete`, possibly evicting another
+ * state. Returns the new entry. */
+struct candidate_entry *candidate_cache_put(struct candidate_cache *c, const char *state, enum palindrome_direction direction,
+		const long *ids, long num_ids, bool complete);
+
+/* forgets every state, e.g., once the dictionary the candidates were taken
+ * from is replaced. Counters are kept. */
+void candidate_cache_clear(struct candidate_cache *c);
+
+/* releases the memory used by the cache */
+int candidate_cache_destroy(struct candidate_cache *c);
+
+#endif /* CANDIDATE_CACHE_H */
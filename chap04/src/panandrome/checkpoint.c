@@ -0,0 +1,227 @@
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* appends `n` bytes to the record, which must have room for them */
+#define PUT(r, ptr, n) { \
+	memcpy(&((r)->buf[(r)->len]), (ptr), (n)); \
+	(r)->len += (n); \
+}
+
+/* reads `n` bytes from the record, failing if it is too short */
+#define GET(r, off, ptr, n) { \
+	ErrorCase((off) + (n) > (r)->len, EINVAL, -1); \
+	memcpy((ptr), &((r)->buf[(off)]), (n)); \
+	(off) += (n); \
+}
+
+int
+checkpoint_encode(struct checkpoint_record *r, const struct search *s, const struct checkpoint_streams *streams)
+{
+	ErrorCase(r == NULL || s == NULL || streams == NULL, EINVAL, -1);
+
+	int64_t counters[6], ntrail = s->moves - s->committed,
+	        nblocks = s->used != NULL ? WORD_LIST_BLOCKS(s->nouns->num_words) : 0;
+	uint32_t id;
+	uint8_t direction = s->direction, statelen = strlen(s->state);
+	size_t needed;
+	long i;
+	void *p;
+
+	needed = sizeof(uint32_t) + 2 * sizeof(uint8_t) + statelen + sizeof(counters) +
+		sizeof(struct checkpoint_streams) + sizeof(int64_t) + ntrail * sizeof(uint32_t) +
+		sizeof(int64_t) + nblocks * sizeof(uint64_t);
+
+	if (needed > r->size) {
+		p = realloc(r->buf, 2 * needed);
+		ErrorCase(p == NULL, errno, -1);
+		r->buf = p;
+		r->size = 2 * needed;
+	}
+
+	counters[0] = s->curpos;
+	counters[1] = s->total;
+	counters[2] = s->moves;
+	counters[3] = s->committed;
+	counters[4] = s->lead;
+	counters[5] = s->tail;
+
+	r->len = 0;
+	PUT(r, &s->seed, sizeof(uint32_t));
+	PUT(r, &direction, sizeof(uint8_t));
+	PUT(r, &statelen, sizeof(uint8_t));
+	PUT(r, s->state, statelen);
+	PUT(r, counters, sizeof(counters));
+	PUT(r, streams, sizeof(struct checkpoint_streams));
+	PUT(r, &ntrail, sizeof(int64_t));
+
+	for (i = 0; i < ntrail; ++i) {
+		id = s->trail[s->trail_start + i];
+		PUT(r, &id, sizeof(uint32_t));
+	}
+
+	PUT(r, &nblocks, sizeof(int64_t));
+	PUT(r, s->used, nblocks * sizeof(uint64_t));
+
+	return 0;
+}
+
+int
+checkpoint_decode(const struct checkpoint_record *r, struct search *s, struct checkpoint_streams *streams)
+{
+	ErrorCase(r == NULL || s == NULL || streams == NULL, EINVAL, -1);
+
+	int64_t counters[6], ntrail, nblocks;
+	uint32_t seed, id;
+	uint8_t direction, statelen;
+	size_t off = 0;
+	long i;
+	void *p;
+
+	GET(r, off, &seed, sizeof(uint32_t));
+	GET(r, off, &direction, sizeof(uint8_t));
+	GET(r, off, &statelen, sizeof(uint8_t));
+	ErrorCase(statelen >= WORD_LIST_LARGEST_NOUN || direction > RIGHT, EINVAL, -1);
+	GET(r, off, s->state, statelen);
+	s->state[statelen] = '\0';
+	GET(r, off, counters, sizeof(counters));
+	GET(r, off, streams, sizeof(struct checkpoint_streams));
+	ErrorCase(streams->worker < 0 || streams->worker > INT_MAX, EINVAL, -1);
+	GET(r, off, &ntrail, sizeof(int64_t));
+
+	ErrorCase(ntrail < 0 || ntrail != counters[2] - counters[3], EINVAL, -1);
+	ErrorCase(off + ntrail * sizeof(uint32_t) > r->len, EINVAL, -1);
+
+	s->seed = seed;
+	s->direction = direction;
+	s->curpos = counters[0];
+	s->total = counters[1];
+	s->moves = counters[2];
+	s->committed = counters[3];
+	s->lead = counters[4];
+	s->tail = counters[5];
+
+	if (ntrail > s->trail_size) {
+		p = realloc(s->trail, ntrail * sizeof(long));
+		ErrorCase(p == NULL, errno, -1);
+		s->trail = p;
+		s->trail_size = ntrail;
+	}
+
+	s->trail_start = 0;
+	for (i = 0; i < ntrail; ++i) {
+		GET(r, off, &id, sizeof(uint32_t));
+		s->trail[i] = id;
+	}
+
+	GET(r, off, &nblocks, sizeof(int64_t));
+	ErrorCase(nblocks != (s->used != NULL ? WORD_LIST_BLOCKS(s->nouns->num_words) : 0), EINVAL, -1);
+	GET(r, off, s->used, nblocks * sizeof(uint64_t));
+	ErrorCase(off != r->len, EINVAL, -1);
+
+	return search_replay(s);
+}
+
+int
+checkpoint_write(const char *path, const struct checkpoint_header *h, const struct checkpoint_record *records)
+{
+	ErrorCase(path == NULL || h == NULL, EINVAL, -1);
+
+	char tmp[PATH_MAX];
+	uint64_t len;
+	uint32_t i;
+	FILE *f;
+
+	snprintf(tmp, PATH_MAX, "%s.tmp", path);
+	f = fopen(tmp, "w");
+	ErrorCase(f == NULL, errno, -1);
+
+	fwrite(CHECKPOINT_MAGIC, 1, sizeof(CHECKPOINT_MAGIC), f);
+	fwrite(h, sizeof(struct checkpoint_header), 1, f);
+
+	for (i = 0; i < h->num_records; ++i) {
+		len = records[i].len;
+		fwrite(&len, sizeof(uint64_t), 1, f);
+		fwrite(records[i].buf, 1, records[i].len, f);
+	}
+
+	/* the new checkpoint only replaces the old one once it is complete */
+	if (fflush(f) == EOF || ferror(f) || fsync(fileno(f)) == -1) {
+		fclose(f);
+		unlink(tmp);
+		return -1;
+	}
+
+	ErrorCase(fclose(f) == EOF, errno, -1);
+	ErrorCase(rename(tmp, path) == -1, errno, -1);
+
+	return 0;
+}
+
+int
+checkpoint_read(const char *path, struct checkpoint_header *h, struct checkpoint_record **records)
+{
+	ErrorCase(path == NULL || h == NULL || records == NULL, EINVAL, -1);
+
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	struct checkpoint_record *r;
+	uint64_t len;
+	uint32_t i;
+	FILE *f;
+
+	f = fopen(path, "r");
+	ErrorCase(f == NULL, errno, -1);
+
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+			memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+			fread(h, sizeof(struct checkpoint_header), 1, f) != 1 ||
+			h->version != CHECKPOINT_VERSION || h->num_records == 0) {
+		fclose(f);
+		errno = EINVAL;
+		return -1;
+	}
+
+	r = calloc(h->num_records, sizeof(struct checkpoint_record));
+	if (r == NULL) {
+		fclose(f);
+		return -1;
+	}
+
+	for (i = 0; i < h->num_records; ++i) {
+		if (fread(&len, sizeof(uint64_t), 1, f) != 1 ||
+				(r[i].buf = malloc(len)) == NULL ||
+				fread(r[i].buf, 1, len, f) != len) {
+			checkpoint_free(r, h->num_records);
+			fclose(f);
+			errno = EINVAL;
+			return -1;
+		}
+
+		r[i].len = r[i].size = len;
+	}
+
+	fclose(f);
+	*records = r;
+
+	return 0;
+}
+
+void
+checkpoint_free(struct checkpoint_record *records, long n)
+{
+	long i;
+
+	for (i = 0; i < n; ++i)
+		free(records[i].buf);
+
+	free(records);
+}
@@ -0,0 +1,85 @@
+/* checkpoint - saving and restoring the state of running searches.
+ *
+ * A checkpoint is a compact binary file, holding a small header followed by
+ * one record per search. Words are saved as their positions in the
+ * dictionary, never as strings, so the same nouns list must be given when a
+ * checkpoint is resumed. Numbers are saved in the native byte order: a
+ * checkpoint is meant to be resumed on the machine that wrote it.
+ *
+ * 	header: magic ("PANCKPT"), version, number of records, palindrome size,
+ * 	        number of words in the dictionary, random seed
+ * 	record: length, PRNG state, direction, state, counters, streams (with
+ * 	        the id of the worker that owns the spools), the
+ * 	        dictionary positions of the words in the search trail, and the
+ * 	        bitset of the words used so far (empty unless the search uses
+ * 	        each noun once) */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "search.h"
+
+#define CHECKPOINT_MAGIC   ("PANCKPT")
+#define CHECKPOINT_VERSION (3)
+
+/* how often, in seconds, a checkpoint is written by default */
+#ifndef CHECKPOINT_INTERVAL
+#  define CHECKPOINT_INTERVAL (5)
+#endif
+
+struct checkpoint_header {
+	uint32_t version;
+	uint32_t num_records;
+	int64_t size;      /* target palindrome size */
+	int64_t num_words; /* number of words in the dictionary */
+	uint32_t seed;     /* seed the run was started with */
+};
+
+/* how much of each spool a search had written when the checkpoint was
+ * taken. The spools are truncated back to these offsets on resume. Spools
+ * are named after the worker that created them, which keeps its `worker` id
+ * across resumes: only the workers still searching are checkpointed, so
+ * resumed workers are not numbered as the original ones. */
+struct checkpoint_streams {
+	int64_t worker;
+	int64_t left_offset, left_written;
+	int64_t right_offset, right_written;
+};
+
+/* an encoded search */
+struct checkpoint_record {
+	char *buf;
+	size_t len, size;
+};
+
+/* encodes the search `s` and its `streams` into the record `r`, reusing the
+ * memory from a previous encoding if possible.
+ *
+ * Returns a positive number on success, -1 on error */
+int checkpoint_encode(struct checkpoint_record *r, const struct search *s, const struct checkpoint_streams *streams);
+
+/* restores the search `s` (already initialized with the same nouns list) and
+ * its `streams` from the record `r`.
+ *
+ * Returns a positive number on success, -1 on error, with errno set to EINVAL
+ * if the record is malformed or does not match the dictionary */
+int checkpoint_decode(const struct checkpoint_record *r, struct search *s, struct checkpoint_streams *streams);
+
+/* atomically replaces the checkpoint at `path` by one with the given header
+ * and `h->num_records` records.
+ *
+ * Returns a positive number on success, -1 on error */
+int checkpoint_write(const char *path, const struct checkpoint_header *h, const struct checkpoint_record *records);
+
+/* reads the checkpoint at `path`. The records are allocated, and must be
+ * released with `checkpoint_free`.
+ *
+ * Returns a positive number on success, -1 on error */
+int checkpoint_read(const char *path, struct checkpoint_header *h, struct checkpoint_record **records);
+
+/* releases the `n` records allocated by `checkpoint_read` */
+void checkpoint_free(struct checkpoint_record *records, long n);
+
+#endif /* CHECKPOINT_H */
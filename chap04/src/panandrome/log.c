@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "log.h"
+
+void
+log_write(const char *fmt, ...)
+{
+	char line[512];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		return;
+	if ((size_t) n > sizeof(line) - 2)
+		n = sizeof(line) - 2;
+
+	line[n] = '\n';
+	line[n + 1] = '\0';
+
+	/* a single call, so that it is not interleaved with other threads */
+	fprintf(stderr, ">> %s", line);
+}
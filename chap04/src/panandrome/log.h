@@ -0,0 +1,33 @@
+/* log - levelled diagnostic messages, written to the standard error.
+ *
+ * Messages above `LOG_LEVEL` are removed at compile time, arguments
+ * included, so that logging calls can be left in the hottest paths. To see
+ * what the search is doing at every step, build with:
+ *
+ * 	$ make CPPFLAGS=-DLOG_LEVEL=LOG_LEVEL_DEBUG */
+
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_LEVEL_ERROR (0)
+#define LOG_LEVEL_INFO  (1)
+#define LOG_LEVEL_DEBUG (2)
+
+#ifndef LOG_LEVEL
+#  define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG(level, ...) do { \
+	if ((level) <= LOG_LEVEL) \
+		log_write(__VA_ARGS__); \
+} while (0)
+
+#define log_error(...) LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_info(...)  LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...) LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+/* writes a single line, prefixed by ">> ", to the standard error. Lines
+ * written by different threads are never mixed. */
+void log_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif /* LOG_H */
@@ -0,0 +1,89 @@
+#include "metrics.h"
+
+static const char *phase_names[NUM_PHASES] = { "load", "init", "search", "output" };
+
+static long long now(void);
+static double elapsed(struct metrics *m, enum metrics_phase phase);
+
+void
+metrics_begin(struct metrics *m, enum metrics_phase phase)
+{
+	atomic_store(&m->begin[phase], now());
+}
+
+void
+metrics_end(struct metrics *m, enum metrics_phase phase)
+{
+	atomic_store(&m->end[phase], now());
+}
+
+void
+metrics_sum(struct metrics_counters *total, const struct metrics_counters *c)
+{
+	atomic_fetch_add(&total->lookups, atomic_load(&c->lookups));
+	atomic_fetch_add(&total->selector_calls, atomic_load(&c->selector_calls));
+	atomic_fetch_add(&total->signature_skips, atomic_load(&c->signature_skips));
+	atomic_fetch_add(&total->candidates, atomic_load(&c->candidates));
+	atomic_fetch_add(&total->rollbacks, atomic_load(&c->rollbacks));
+	atomic_fetch_add(&total->words_added, atomic_load(&c->words_added));
+	atomic_fetch_add(&total->cache_hits, atomic_load(&c->cache_hits));
+	atomic_fetch_add(&total->cache_misses, atomic_load(&c->cache_misses));
+	atomic_fetch_add(&total->cache_evictions, atomic_load(&c->cache_evictions));
+}
+
+int
+metrics_dump(FILE *f, struct metrics *m, const struct metrics_counters *total, long nworkers)
+{
+	double search = elapsed(m, PHASE_SEARCH);
+	unsigned long hits = atomic_load(&total->cache_hits),
+	              misses = atomic_load(&total->cache_misses);
+	int i, retval;
+
+	/* reports may be requested by several threads at once (e.g., on
+	 * SIGUSR1 while the run ends): each one is written as a whole */
+	flockfile(f);
+
+	fprintf(f, "{\"workers\": %ld, \"phases\": {", nworkers);
+	for (i = 0; i < NUM_PHASES; ++i)
+		fprintf(f, "%s\"%s\": %.6f", i > 0 ? ", " : "", phase_names[i], elapsed(m, i));
+	fprintf(f, "}, ");
+
+	fprintf(f, "\"lookups\": %lu, \"selector_calls\": %lu, \"signature_skips\": %lu, \"candidates\": %lu, "
+			"\"rollbacks\": %lu, \"words_added\": %lu, \"words_per_second\": %.1f, ",
+			atomic_load(&total->lookups), atomic_load(&total->selector_calls),
+			atomic_load(&total->signature_skips),
+			atomic_load(&total->candidates), atomic_load(&total->rollbacks),
+			atomic_load(&total->words_added),
+			search > 0 ? atomic_load(&total->words_added) / search : 0.0);
+
+	fprintf(f, "\"cache\": {\"hits\": %lu, \"misses\": %lu, \"evictions\": %lu, \"hit_rate\": %.4f}}\n",
+			hits, misses, atomic_load(&total->cache_evictions),
+			hits + misses > 0 ? (double) hits / (hits + misses) : 0.0);
+
+	retval = fflush(f) == EOF ? -1 : 0;
+	funlockfile(f);
+
+	return retval;
+}
+
+static long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* seconds spent in the phase so far */
+static double
+elapsed(struct metrics *m, enum metrics_phase phase)
+{
+	long long begin = atomic_load(&m->begin[phase]),
+	          end = atomic_load(&m->end[phase]);
+
+	if (begin == 0)
+		return 0.0;
+
+	return ((end != 0 ? end : now()) - begin) / 1e9;
+}
@@ -0,0 +1,53 @@
+/* metrics - counters and timings of a palindrome generation run.
+ *
+ * Counters belong to a single thread, which is the only one to update them,
+ * but can be read at any time by any other (e.g., to report the progress of
+ * a long run). Updates are therefore plain relaxed loads and stores, with no
+ * locking or read-modify-write instructions involved. */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+enum metrics_phase { PHASE_LOAD, PHASE_INIT, PHASE_SEARCH, PHASE_OUTPUT, NUM_PHASES };
+
+struct metrics_counters {
+	atomic_ulong lookups;        /* words requested from the dictionary */
+	atomic_ulong selector_calls; /* dictionary words tested against a state */
+	atomic_ulong signature_skips; /* dictionary words passed over by their letters */
+	atomic_ulong candidates;     /* dictionary words that fit a state */
+	atomic_ulong rollbacks;      /* moves undone */
+	atomic_ulong words_added;    /* moves made */
+
+	atomic_ulong cache_hits, cache_misses, cache_evictions;
+};
+
+/* to be used only by the thread that owns the counters */
+#define METRICS_ADD(c, field, n) \
+	atomic_store_explicit(&(c)->field, atomic_load_explicit(&(c)->field, memory_order_relaxed) + (n), \
+			memory_order_relaxed)
+#define METRICS_INC(c, field) METRICS_ADD(c, field, 1)
+
+struct metrics {
+	/* time (in nanoseconds, from a monotonic clock) at which each phase
+	 * started and ended, or zero if it did not yet */
+	atomic_llong begin[NUM_PHASES];
+	atomic_llong end[NUM_PHASES];
+};
+
+/* marks the beginning and the end of a phase */
+void metrics_begin(struct metrics *m, enum metrics_phase phase);
+void metrics_end(struct metrics *m, enum metrics_phase phase);
+
+/* adds the counters in `c` to `total` */
+void metrics_sum(struct metrics_counters *total, const struct metrics_counters *c);
+
+/* writes the phase timings and the `total` counters of a run with `nworkers`
+ * searches to `f`, as a JSON object. Phases still running are reported up to
+ * the current time. Concurrent dumps to the same `f` do not interleave. */
+int metrics_dump(FILE *f, struct metrics *m, const struct metrics_counters *total, long nworkers);
+
+#endif /* METRICS_H */
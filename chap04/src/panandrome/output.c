@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "word_list.h"
+#include "output.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* punctuation, article, space, word and a spare byte for the frame length */
+#define WORD_MAXLEN (WORD_LIST_LARGEST_NOUN + 8)
+
+static int write_all(int fd, struct iovec *iov, int iovcnt);
+
+int
+output_init(struct output *o, int fd, bool framed)
+{
+	ErrorCase(o == NULL || fd < 0, EINVAL, -1);
+
+	o->buf = malloc(OUTPUT_BUFSIZE);
+	ErrorCase(o->buf == NULL, errno, -1);
+
+	o->fd = fd;
+	o->framed = framed;
+	o->len = 0;
+	o->written = 0;
+
+	return 0;
+}
+
+int
+output_write(struct output *o, const char *s, size_t n)
+{
+	struct iovec iov[2];
+
+	if (o->len + n <= OUTPUT_BUFSIZE) {
+		memcpy(&(o->buf[o->len]), s, n);
+		o->len += n;
+		return 0;
+	}
+
+	/* does not fit: send the buffer and the new data together */
+	iov[0].iov_base = o->buf;
+	iov[0].iov_len = o->len;
+	iov[1].iov_base = (void *) s;
+	iov[1].iov_len = n;
+
+	o->len = 0;
+	return write_all(o->fd, iov, 2);
+}
+
+/* for the first word in the palindrome, the article should be uppercased,
+ * and not prefixed with a comma; in case it is the last word (Panama), there
+ * should be no comma, but a dash instead. */
+int
+output_word(struct output *o, const char *word, bool first, bool last)
+{
+	char text[WORD_MAXLEN + 1], article[3];
+	size_t len = 0, wordlen = strnlen(word, WORD_LIST_LARGEST_NOUN);
+
+	word_list_article(word, article);
+
+	if (last) {
+		memcpy(text, " - ", 3);
+		len = 3;
+	} else {
+		if (first) {
+			article[0] = toupper(article[0]);
+		} else {
+			memcpy(text, ", ", 2);
+			len = 2;
+		}
+
+		memcpy(&(text[len]), article, strlen(article));
+		len += strlen(article);
+		text[len++] = ' ';
+	}
+
+	memcpy(&(text[len]), word, wordlen);
+	len += wordlen;
+
+	/* end with an exciting exclamation mark! */
+	if (last)
+		text[len++] = '!';
+
+	if (o->framed) {
+		text[len] = (char) len;
+		++len;
+	}
+
+	++o->written;
+	return output_write(o, text, len);
+}
+
+int
+output_words(struct output *o, const struct word_list *wl, bool first, bool last)
+{
+	long i, n = wl->num_words;
+
+	for (i = 0; i < n; ++i)
+		if (output_word(o, WORD_LIST_WORD(wl, i), first && i == 0, last && i == n - 1) == -1)
+			return -1;
+
+	return 0;
+}
+
+int
+output_reverse(struct output *o, int fd)
+{
+	char *buf;
+	off_t pos;
+	size_t have, reclen, n;
+	ssize_t r;
+
+	ErrorCase((pos = lseek(fd, 0, SEEK_END)) == -1, errno, -1);
+
+	buf = malloc(OUTPUT_BUFSIZE);
+	ErrorCase(buf == NULL, errno, -1);
+
+	/* `buf` holds the `have` bytes of the spool starting at `pos`; records
+	 * are consumed from its end, and earlier parts of the file are read
+	 * in front of them when a record is not complete */
+	have = 0;
+	while (have > 0 || pos > 0) {
+		reclen = have > 0 ? (unsigned char) buf[have - 1] : 0;
+
+		if (have == 0 || have < reclen + 1) {
+			if (pos == 0) {
+				free(buf);
+				errno = EINVAL; /* truncated spool */
+				return -1;
+			}
+
+			n = OUTPUT_BUFSIZE - have;
+			if ((off_t) n > pos)
+				n = pos;
+
+			memmove(&(buf[n]), buf, have);
+			pos -= n;
+			r = pread(fd, buf, n, pos);
+			if (r != (ssize_t) n) {
+				free(buf);
+				errno = (r == -1 ? errno : EIO);
+				return -1;
+			}
+
+			have += n;
+			continue;
+		}
+
+		have -= reclen + 1;
+		if (output_write(o, &(buf[have]), reclen) == -1) {
+			free(buf);
+			return -1;
+		}
+		++o->written;
+	}
+
+	free(buf);
+	return 0;
+}
+
+int
+output_flush(struct output *o)
+{
+	struct iovec iov;
+
+	iov.iov_base = o->buf;
+	iov.iov_len = o->len;
+
+	o->len = 0;
+	return write_all(o->fd, &iov, 1);
+}
+
+int
+output_destroy(struct output *o)
+{
+	ErrorCase(o == NULL, EINVAL, -1);
+
+	int retval = output_flush(o);
+
+	free(o->buf);
+	o->buf = NULL;
+
+	return retval;
+}
+
+/* `writev(2)` may write less than asked for: keep going until everything
+ * is written */
+static int
+write_all(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
+
+	while (iovcnt > 0) {
+		if (iov->iov_len == 0) {
+			++iov;
+			--iovcnt;
+			continue;
+		}
+
+		n = writev(fd, iov, iovcnt);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (n > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+
+		if (n > 0) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+/* output - buffered writing of (possibly very large) palindromes.
+ *
+ * Words are formatted straight into a large buffer, which is handed to
+ * `write(2)`/`writev(2)` only when full, instead of going through several
+ * small stdio calls per word.
+ *
+ * An output can also be used as a spool for the right end of a palindrome,
+ * which is produced backwards (from the last word to the middle): in that
+ * case, each formatted word is followed by its length, so that the spool can
+ * later be copied, in reverse order, with `output_reverse`. */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "word_list.h"
+
+#ifndef OUTPUT_BUFSIZE
+#  define OUTPUT_BUFSIZE (1 << 16)
+#endif
+
+struct output {
+	int fd;         /* where the buffer is flushed to */
+	bool framed;    /* whether words are followed by their length */
+	char *buf;
+	size_t len;     /* bytes currently in the buffer */
+	long written;   /* number of words written so far */
+};
+
+/* initializes an output that writes to the (already open) file descriptor
+ * `fd`. If `framed` is set, the output is a spool to be read by `output_reverse`.
+ *
+ * Returns a positive number on success, -1 on error */
+int output_init(struct output *o, int fd, bool framed);
+
+/* appends `n` bytes from `s` to the output */
+int output_write(struct output *o, const char *s, size_t n);
+
+/* appends a palindrome `word`, preceded by its article and the appropriate
+ * punctuation. The `first` word of a palindrome has its article capitalized,
+ * and the `last` one is followed by an exclamation mark. */
+int output_word(struct output *o, const char *word, bool first, bool last);
+
+/* appends every word in `wl`, as `output_word` does. If `first` is set, the
+ * first word starts the palindrome and, if `last` is set, the last word ends
+ * it. */
+int output_words(struct output *o, const struct word_list *wl, bool first, bool last);
+
+/* appends the words in the spool `fd` (written by a framed output, and already
+ * flushed) in the reverse order they were written */
+int output_reverse(struct output *o, int fd);
+
+/* writes whatever is buffered to the file descriptor */
+int output_flush(struct output *o);
+
+/* flushes and releases the output. The file descriptor is not closed. */
+int output_destroy(struct output *o);
+
+#endif /* OUTPUT_H */
@@ -16,11 +16,48 @@
  * however, limited to the number of nouns present on the list given to
  * this program.
  *
+ * The search is a randomized walk, and several of them can run at once:
+ * every worker shares the (read-only) nouns list, but has its own palindrome,
+ * state and random number generator. The first worker to reach the target
+ * size wins, and the others are stopped.
+ *
+ * Optionally, the dictionary can be analysed before the search starts, in
+ * order to find out which leftover states can still be closed into a
+ * palindrome (see state_graph.h). Words that lead to dead ends are then never
+ * chosen, and once the palindrome is large enough, the search heads straight
+ * to the closest closure.
+ *
  * Usage:
  *
- * 	$ ./panandrome <nouns_list> [<palindrome_words>]
+ * 	$ ./panandrome [-c <entries>] [-g] [-j <workers>] [-k <checkpoint> [--resume]] [-m <metrics>] [-o <file>] [-s <seed>] [-u]
+ * 	               <nouns_list> [<palindrome_words>]
+ * 	$ ./panandrome -d <socket> [-c <entries>] [-g] [-j <workers>] [-m <metrics>] [-u] <nouns_list>
  *
- * 	nouns_list - a text file of English nouns, with one word per line.
+ * 	entries - number of states each worker remembers the fitting words for.
+ * 	          Defaults to CANDIDATE_CACHE_ENTRIES, at most
+ * 	          CANDIDATE_CACHE_MAX_ENTRIES; 0 disables the cache.
+ * 	socket - run as a daemon, answering requests for palindromes on the
+ * 	         given Unix domain socket (see server.h) until SIGINT or
+ * 	         SIGTERM, with the nouns list loaded only once (and again on
+ * 	         SIGHUP).
+ * 	-g - prune the search with the state closure graph.
+ * 	workers - number of concurrent searches (or, as a daemon, of requests
+ * 	          answered at once). Defaults to the number of online processors.
+ * 	checkpoint - every CHECKPOINT_INTERVAL seconds, save the state of the
+ * 	             search to the given file. With --resume (or -r), an
+ * 	             interrupted search is resumed from that file instead (the
+ * 	             nouns list, and the output file, if any, must be the same).
+ * 	metrics - write counters and timings of the run, as JSON, to the given
+ * 	          file ("-" for the standard error) when it finishes. They are
+ * 	          also written (by default, to the standard error) on SIGUSR1.
+ * 	file - write the palindrome to the given file, instead of the standard
+ * 	       output. Words are streamed to disk while the search goes on, so
+ * 	       that only the last SEARCH_HORIZON of them are kept in memory.
+ * 	seed - seed for the random number generators. Defaults to the current time.
+ * 	-u - use each noun at most once. Small dictionaries may then run out of
+ * 	     words that close the palindrome.
+ * 	nouns_list - a text file of English nouns, with one word per line, or
+ * 	             the same list compiled with word_list_compile.
  * 	palindrome_size - the number of words the generated palindrome is to
  * 	                  contain. If not specified, a default of 10 is assumed.
  *
@@ -35,262 +72,607 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "word_list.h"
+#include "state_graph.h"
+#include "candidate_cache.h"
+#include "search.h"
+#include "output.h"
+#include "server.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "log.h"
 
 static char *progname = "panandrome";
-static char state[WORD_LIST_LARGEST_NOUN]; /* the part that do not fit the palindrome */
-static char previous_state[WORD_LIST_LARGEST_NOUN]; /* allows rollback */
 
-enum palindrome_direction { LEFT, RIGHT };
+/* each worker owns its search context; only the dictionary is shared */
+struct worker {
+	pthread_t thread;
+	int id;
+	struct search search;
+	struct candidate_cache cache;
+	int status; /* return value of `search_run` */
+
+	/* when streaming, committed words of each half are written to these.
+	 * Spools are named after `stream_id`, the id of the worker in the run
+	 * that created them (which differs from `id` after a resume). */
+	struct output left, right;
+	int stream_id;
+	char left_path[PATH_MAX], right_path[PATH_MAX];
+
+	/* checkpointing: the worker is interrupted, encodes its search into
+	 * `record` and clears `requested`. Both `requested` and `finished` are
+	 * protected by `lock`. */
+	atomic_bool interrupt;
+	bool requested, finished;
+	struct checkpoint_record record;
+};
+
+static struct worker *workers;
+static long nworkers;
+
+static atomic_bool stop;       /* set as soon as a palindrome is found */
+static atomic_int winner = -1; /* the worker that found it */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER; /* a worker finished or took a snapshot */
+static long running;                                      /* number of workers still searching */
+
+static struct metrics metrics;
+static FILE *metrics_file;        /* where metrics are written to on SIGUSR1 */
+static atomic_bool reporter_done; /* makes the reporter thread return */
+
+static struct option options[] = {
+	{ "cache",      required_argument, NULL, 'c' },
+	{ "daemon",     required_argument, NULL, 'd' },
+	{ "graph",      no_argument,       NULL, 'g' },
+	{ "jobs",       required_argument, NULL, 'j' },
+	{ "checkpoint", required_argument, NULL, 'k' },
+	{ "metrics",    required_argument, NULL, 'm' },
+	{ "output",     required_argument, NULL, 'o' },
+	{ "resume",     no_argument,       NULL, 'r' },
+	{ "seed",       required_argument, NULL, 's' },
+	{ "unique",     no_argument,       NULL, 'u' },
+	{ NULL, 0, NULL, 0 }
+};
 
 static void usage(void);
 static long palindrome_size(const char *arg);
+static long workers_count(const char *arg);
+static long cache_entries(const char *arg);
 static void pexit(const char *fname);
+static void *run_worker(void *arg);
 
-/* initializes a given `palindrome` with the short default of
- * "A man, a plan, a canal - Panama!" */
-static void initialize_palindrome(struct word_list *palindrome);
-static int print_palindrome(const char *word, char *article, long pos, long total);
-static bool (*word_selector(enum palindrome_direction dir))(const char *word, char *article);
-static bool is_palindrome(const char *word);
-static void change_state(const char *word, char *article, enum palindrome_direction direction);
+static void snapshot(struct worker *w);
+static void checkpoint_loop(const char *path, const struct checkpoint_header *h);
+static void stop_all(void);
+static void *report_on_signal(void *arg);
+static void report(FILE *f);
+
+static int stream_worker(struct worker *w, const char *outfile, const struct checkpoint_streams *resumed);
+static int spill_word(const char *word, enum palindrome_direction side, void *data);
+static int write_palindrome(struct output *o, struct search *s);
+static int finish_stream(struct worker *w, const char *outfile, bool keep);
 
 int main(int argc, char *argv[])
 {
-	if (argc < 2)
+	long i, cache_size = CANDIDATE_CACHE_ENTRIES;
+	unsigned int seed = time(NULL);
+	char *outfile = NULL, *checkpoint = NULL, *socket_path = NULL;
+	struct output out;
+	struct checkpoint_header header;
+	struct checkpoint_record *records = NULL;
+	struct checkpoint_streams streams;
+	char *metrics_path = NULL;
+	bool prune = false, resume = false, unique = false;
+	pthread_t reporter;
+	sigset_t usr1;
+	int opt, s;
+
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt_long(argc, argv, "c:d:gj:k:m:o:rs:u", options, NULL)) != -1) {
+		switch (opt) {
+			case 'c':
+				cache_size = cache_entries(optarg);
+				break;
+			case 'd':
+				socket_path = optarg;
+				break;
+			case 'g':
+				prune = true;
+				break;
+			case 'j':
+				nworkers = workers_count(optarg);
+				break;
+			case 'k':
+				checkpoint = optarg;
+				break;
+			case 'm':
+				metrics_path = optarg;
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case 'r':
+				resume = true;
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'u':
+				unique = true;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (optind >= argc || (resume && checkpoint == NULL) ||
+			(socket_path != NULL && (checkpoint != NULL || outfile != NULL)))
 		usage();
 
-	long size = palindrome_size(argv[2]), total, curpos, lastpos;
-	struct word_list nouns, palindrome;
-	char curword[WORD_LIST_LARGEST_NOUN], article[3];
-	char direction;
+	long size = palindrome_size(argv[optind + 1]);
+	struct word_list nouns;
+	struct state_graph graph;
+
+	if (nworkers <= 0)
+		nworkers = 1;
 
-	srand(time(NULL));
+	metrics_file = stderr;
+	if (metrics_path != NULL && strcmp(metrics_path, "-") != 0 && (metrics_file = fopen(metrics_path, "w")) == NULL)
+		pexit("fopen");
 
-	/* assuming a reasonably large nouns list. If you use a different list
-	 * than the one provided with this source file, then you might need to
-	 * change this value*/
-	if (word_list_init(&nouns, 150000) == -1)
-		pexit("word_list_init");
-	printf(">> Initialized nouns list\n");
+	/* SIGUSR1 is only handled by the reporter thread: every other thread
+	 * inherits this mask */
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+	if ((s = pthread_sigmask(SIG_BLOCK, &usr1, NULL)) != 0) {
+		errno = s;
+		pexit("pthread_sigmask");
+	}
 
-	if (word_list_init(&palindrome, 100 * size) == -1)
-		pexit("word_list_init");
-	printf(">> Initialized palindrome list\n");
+	/* the server loads (and reloads) the nouns list on its own */
+	if (socket_path != NULL) {
+		struct server server = {
+			.path = socket_path,
+			.nouns_path = argv[optind],
+			.prune = prune,
+			.cache_size = cache_size,
+			.unique = unique,
+			.nworkers = nworkers,
+		};
+
+		if (server_run(&server, &metrics, metrics_file) == -1)
+			pexit("server_run");
+
+		exit(EXIT_SUCCESS);
+	}
 
-	FILE *db = fopen(argv[1], "r");
-	if (db == NULL)
-		pexit("fopen");
+	metrics_begin(&metrics, PHASE_LOAD);
 
-	if (word_list_load(&nouns, db) == -1)
-		pexit("word_list_load");
-	printf(">> Loaded nouns into memory\n");
-
-	initialize_palindrome(&palindrome);
-	printf(">> Built starting palindrome\n");
-
-	strncpy(state, "aca", 4);
-	strncpy(previous_state, "aca", 4);
-	direction = LEFT;
-	curpos = 2; /* first added word should be at the left of position 2 */
-	lastpos = curpos;
-	total = 4;  /* starting palindrome size */
-
-	printf(">> Main loop will start: state=%s total=%ld position=%ld size=%ld\n", state, total, curpos, size);
-	/* main palindrome generation loop */
-	while (total < size || !is_palindrome(state)) {
-		if (word_list_rlookup(&nouns, word_selector(direction), curword, article) == -1) {
-			word_list_remove_at(&palindrome, lastpos);
-			strncpy(state, previous_state, WORD_LIST_LARGEST_NOUN);
-			--total;
-			direction = (direction == LEFT ? RIGHT : LEFT);
-			continue;
-			/* fprintf(stderr, "%s: no available words for a %ld words long palindrome\n", progname, size); */
-			/* exit(EXIT_FAILURE); */
+	/* compiled dictionaries (see word_list_compile) are mapped as they are;
+	 * anything else is read as a text file */
+	if (word_list_load_path(&nouns, argv[optind]) == -1)
+		pexit("word_list_load_path");
+	log_info("Loaded nouns into memory: words=%ld", nouns.num_words);
+	metrics_end(&metrics, PHASE_LOAD);
+	metrics_begin(&metrics, PHASE_INIT);
+
+	if (prune) {
+		if (state_graph_build(&graph, &nouns, STATE_GRAPH_MAXLEN) == -1)
+			pexit("state_graph_build");
+		log_info("Built state graph: states=%ld dead=%ld", graph.num_nodes, graph.num_dead);
+	}
+
+	/* a resumed run continues exactly where the checkpointed one was, with
+	 * as many workers as it had */
+	if (resume) {
+		if (checkpoint_read(checkpoint, &header, &records) == -1)
+			pexit("checkpoint_read");
+
+		if (header.num_words != nouns.num_words) {
+			fprintf(stderr, "%s: %s: checkpoint was taken with a different nouns list\n", progname, checkpoint);
+			exit(EXIT_FAILURE);
 		}
 
-		if (word_list_add_at(&palindrome, curword, curpos) == -1)
-			pexit("word_list_add_at");
+		nworkers = header.num_records;
+		size = header.size;
+		seed = header.seed;
+		log_info("Resuming from checkpoint: workers=%ld", nworkers);
+	} else {
+		memset(&header, 0, sizeof(header));
+		header.version = CHECKPOINT_VERSION;
+		header.size = size;
+		header.num_words = nouns.num_words;
+		header.seed = seed;
+	}
+
+	workers = calloc(nworkers, sizeof(struct worker));
+	if (workers == NULL)
+		pexit("calloc");
+
+	/* workers explore independent random branches: each one gets a different
+	 * seed, derived from the one given on the command line */
+	for (i = 0; i < nworkers; ++i) {
+		workers[i].id = workers[i].stream_id = i;
+		if (cache_size > 0 && candidate_cache_init(&workers[i].cache, cache_size) == -1)
+			pexit("candidate_cache_init");
 
-		change_state(curword, article, direction);
+		if (search_init(&workers[i].search, &nouns, prune ? &graph : NULL, cache_size > 0 ? &workers[i].cache : NULL,
+					size, seed + i * 2654435761u) == -1)
+			pexit("search_init");
 
-		lastpos = curpos;
-		if (direction == RIGHT)
-			++curpos;
+		if (unique && search_unique(&workers[i].search) == -1)
+			pexit("search_unique");
 
-		++total;
-		direction = (direction == LEFT ? RIGHT : LEFT);
-		printf(">> After loop: word=%s article=%s state=%s direction=%s position=%ld total=%ld\n", curword, article, state, direction == LEFT ? "LEFT" : "RIGHT", curpos, total);
+		if (resume) {
+			if (checkpoint_decode(&records[i], &workers[i].search, &streams) == -1)
+				pexit("checkpoint_decode");
+			workers[i].stream_id = streams.worker;
+		}
+
+		if (outfile != NULL && stream_worker(&workers[i], outfile, resume ? &streams : NULL) == -1)
+			pexit("stream_worker");
+	}
+
+	if (resume)
+		checkpoint_free(records, nworkers);
+	log_info("Built starting palindrome");
+
+	if ((s = pthread_create(&reporter, NULL, report_on_signal, &usr1)) != 0) {
+		errno = s;
+		pexit("pthread_create");
 	}
-	printf(">> Main loop finished\n");
+
+	metrics_end(&metrics, PHASE_INIT);
+	metrics_begin(&metrics, PHASE_SEARCH);
+
+	log_info("Main loop will start: workers=%ld seed=%u size=%ld", nworkers, seed, size);
+	running = nworkers;
+	for (i = 0; i < nworkers; ++i) {
+		s = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+		if (s != 0) {
+			errno = s;
+			pexit("pthread_create");
+		}
+	}
+
+	if (checkpoint != NULL)
+		checkpoint_loop(checkpoint, &header);
+
+	for (i = 0; i < nworkers; ++i) {
+		s = pthread_join(workers[i].thread, NULL);
+		if (s != 0) {
+			errno = s;
+			pexit("pthread_join");
+		}
+	}
+	metrics_end(&metrics, PHASE_SEARCH);
+	log_info("Main loop finished");
+
+	if (atomic_load(&winner) == -1) {
+		/* the spools of streamed halves are useless without a winner */
+		if (outfile != NULL)
+			for (i = 0; i < nworkers; ++i)
+				finish_stream(&workers[i], outfile, false);
+
+		fprintf(stderr, "%s: no available words for a %ld words long palindrome\n", progname, size);
+		exit(EXIT_FAILURE);
+	}
+
+	/* nothing left to resume */
+	if (checkpoint != NULL)
+		unlink(checkpoint);
 
 	/* print generated palindrome */
-	word_list_traverse(&palindrome, print_palindrome);
-	printf("\n");
+	metrics_begin(&metrics, PHASE_OUTPUT);
+	if (outfile != NULL) {
+		for (i = 0; i < nworkers; ++i)
+			if (finish_stream(&workers[i], outfile, i == atomic_load(&winner)) == -1)
+				pexit("finish_stream");
+	} else {
+		if (output_init(&out, STDOUT_FILENO, false) == -1)
+			pexit("output_init");
+		if (write_palindrome(&out, &workers[atomic_load(&winner)].search) == -1 ||
+				output_write(&out, "\n", 1) == -1 ||
+				output_destroy(&out) == -1)
+			pexit("write_palindrome");
+	}
+	metrics_end(&metrics, PHASE_OUTPUT);
 
+	if (metrics_path != NULL)
+		report(metrics_file);
+
+	/* the reporter reads the counters of the workers, so it must be gone
+	 * before they are released */
+	atomic_store(&reporter_done, true);
+	if ((s = pthread_kill(reporter, SIGUSR1)) != 0 || (s = pthread_join(reporter, NULL)) != 0) {
+		errno = s;
+		pexit("pthread_join");
+	}
+
+	for (i = 0; i < nworkers; ++i) {
+		search_destroy(&workers[i].search);
+		if (cache_size > 0)
+			candidate_cache_destroy(&workers[i].cache);
+		free(workers[i].record.buf);
+	}
+	free(workers);
+	if (prune)
+		state_graph_destroy(&graph);
 	word_list_destroy(&nouns);
-	word_list_destroy(&palindrome);
 
 	exit(EXIT_SUCCESS);
 }
 
-static void
-initialize_palindrome(struct word_list *palindrome)
+/* runs a search until it is finished, or until some other worker finds a
+ * palindrome first. The first worker to finish is elected the winner. The
+ * search is interrupted, now and then, to take a snapshot of it. */
+static void *
+run_worker(void *arg)
 {
-	word_list_append(palindrome, "man");
-	word_list_append(palindrome, "plan");
-	word_list_append(palindrome, "canal");
-	word_list_append(palindrome, "Panama");
+	struct worker *w = arg;
+	int nobody = -1;
+
+	for (;;) {
+		w->status = search_run(&w->search, &w->interrupt);
+		if (w->status != 1 || atomic_load(&stop))
+			break;
+
+		/* `stop` is always set before the interrupt, so checking it again
+		 * after clearing the interrupt makes sure no stop is missed */
+		atomic_store(&w->interrupt, false);
+		if (atomic_load(&stop))
+			break;
+
+		snapshot(w);
+	}
+
+	if (w->status == 0 && atomic_compare_exchange_strong(&winner, &nobody, w->id))
+		stop_all();
+
+	pthread_mutex_lock(&lock);
+	w->finished = true;
+	--running;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
 }
 
-static bool
-left_selector(const char *word, char *article)
+static void
+stop_all(void)
 {
-	char comparable[WORD_LIST_LARGEST_NOUN];
-	snprintf(comparable, WORD_LIST_LARGEST_NOUN, "%s%s", article, word);
+	long i;
 
-	return (strncmp(comparable, state, strlen(state)) == 0);
+	atomic_store(&stop, true);
+	for (i = 0; i < nworkers; ++i)
+		atomic_store(&workers[i].interrupt, true);
 }
 
-static bool
-right_selector(const char *word, char *article)
+/* waits for SIGUSR1, reporting the metrics of the run every time it arrives,
+ * until `reporter_done` is set (and the thread is sent SIGUSR1 to notice) */
+static void *
+report_on_signal(void *arg)
 {
-	/* we have to make sure that the chosen word ends either with 'a' or 'na'
-	 * (reverse of 'an') in order to allow for a new word to be found, since
-	 * an article should precede every word. */
-	char ending1[WORD_LIST_LARGEST_NOUN],
-	     ending2[WORD_LIST_LARGEST_NOUN],
-	     comparable[WORD_LIST_LARGEST_NOUN];
-
-	size_t ending1_len, ending2_len, comparable_len;
-
-	/* if the state already starts with 'a'  or 'na', do nothing */
-	if (state[0] == 'a' || !strncmp(state, "na", 2)) {
-		snprintf(ending1, WORD_LIST_LARGEST_NOUN, "%s", state);
-		snprintf(ending1, WORD_LIST_LARGEST_NOUN, "%s", state);
-	} else {
-		snprintf(ending1, WORD_LIST_LARGEST_NOUN, "a%s", state);
-		snprintf(ending2, WORD_LIST_LARGEST_NOUN, "na%s", state);
-	}
-	snprintf(comparable, WORD_LIST_LARGEST_NOUN, "%s%s", article, word);
+	sigset_t *set = arg;
+	int sig;
 
-	ending1_len = strlen(ending1);
-	ending2_len = strlen(ending2);
-	comparable_len = strlen(comparable);
+	for (;;) {
+		if (sigwait(set, &sig) != 0)
+			continue;
 
-	/* our comparable needs to end with either ending1 or ending2. */
-	return ((strncmp(&(comparable[comparable_len - ending1_len]), ending1, ending1_len) == 0) ||
-			strncmp(&(comparable[comparable_len - ending2_len]), ending1, ending2_len) == 0);
+		if (atomic_load(&reporter_done))
+			break;
 
+		report(metrics_file);
+	}
+
+	return NULL;
 }
 
-static bool
-(*word_selector(enum palindrome_direction dir))(const char *word, char *article)
+/* writes the metrics of the run so far, adding up the counters of every
+ * worker */
+static void
+report(FILE *f)
 {
-	return dir == LEFT ? left_selector : right_selector;
+	struct metrics_counters total;
+	long i;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < nworkers; ++i) {
+		metrics_sum(&total, &workers[i].search.counters);
+		atomic_fetch_add(&total.cache_hits, atomic_load(&workers[i].cache.hits));
+		atomic_fetch_add(&total.cache_misses, atomic_load(&workers[i].cache.misses));
+		atomic_fetch_add(&total.cache_evictions, atomic_load(&workers[i].cache.evictions));
+	}
+
+	metrics_dump(f, &metrics, &total, nworkers);
 }
 
-/* reverses a string in place */
+/* encodes the search of a worker into its checkpoint record. Streamed words
+ * are flushed first, so that the spools are consistent with the record. */
 static void
-reverse(char *word)
+snapshot(struct worker *w)
 {
-	size_t len = strlen(word),
-	       i, j;
-	char c;
-
-	i = 0; j = len - 1;
+	struct checkpoint_streams streams;
+
+	memset(&streams, 0, sizeof(streams));
+	streams.worker = w->stream_id;
+	if (w->left.buf != NULL) {
+		if (output_flush(&w->left) == -1 || output_flush(&w->right) == -1)
+			pexit("output_flush");
+
+		streams.left_offset = lseek(w->left.fd, 0, SEEK_CUR);
+		streams.left_written = w->left.written;
+		streams.right_offset = lseek(w->right.fd, 0, SEEK_CUR);
+		streams.right_written = w->right.written;
+	}
 
-	while (i < j) {
-		c = word[j];
-		word[j] = word[i];
-		word[i] = c;
+	if (checkpoint_encode(&w->record, &w->search, &streams) == -1)
+		pexit("checkpoint_encode");
 
-		++i; --j;
-	}
+	pthread_mutex_lock(&lock);
+	w->requested = false;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
 }
 
-/* changes the algorithm `state` by removing the current state from the union
- * of the article and the chosen word, acccording to the direction that it is
- * being added to the palindrome */
+/* every CHECKPOINT_INTERVAL seconds, while workers are still searching,
+ * collects a snapshot of each of them and writes a checkpoint to `path`.
+ * Workers are only paused while encoding their own search. */
 static void
-change_state(const char *word, char *article, enum palindrome_direction direction)
+checkpoint_loop(const char *path, const struct checkpoint_header *h)
 {
-	size_t s = WORD_LIST_LARGEST_NOUN + 3, /* account for article size */
-	       statelen = strlen(state);
-	char token[s];
+	struct checkpoint_header header = *h;
+	struct checkpoint_record *records;
+	struct timespec deadline;
+	long i, n;
+
+	records = calloc(nworkers, sizeof(struct checkpoint_record));
+	if (records == NULL)
+		pexit("calloc");
+
+	pthread_mutex_lock(&lock);
+	while (running > 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += CHECKPOINT_INTERVAL;
+
+		while (running > 0 && pthread_cond_timedwait(&changed, &lock, &deadline) != ETIMEDOUT)
+			;
+
+		if (running == 0 || atomic_load(&stop))
+			break;
+
+		for (i = 0; i < nworkers; ++i) {
+			if (!workers[i].finished) {
+				workers[i].requested = true;
+				atomic_store(&workers[i].interrupt, true);
+			}
+		}
 
-	strncpy(previous_state, state, statelen + 1); /* backup state */
-	snprintf(token, s, "%s%s", article, word);
+		for (i = 0; i < nworkers; ++i)
+			while (workers[i].requested && !workers[i].finished)
+				pthread_cond_wait(&changed, &lock);
 
-	if (direction == LEFT) {
-		/* state will be same as token, after removing the first letters,
-		 * according to the current state length */
-		strncpy(state, &(token[statelen]), WORD_LIST_LARGEST_NOUN);
-	} else {
-		/* in a similar logic, the new state should be equal to `token`,
-		 * after removing as many letters as we currently have on state */
-		token[strlen(token) - statelen + 1] = '\0';
-		strncpy(state, token, WORD_LIST_LARGEST_NOUN);
+		if (atomic_load(&stop))
+			break;
+
+		/* workers that gave up have nothing to resume */
+		for (i = n = 0; i < nworkers; ++i)
+			if (!workers[i].finished)
+				records[n++] = workers[i].record;
+
+		header.num_records = n;
+		if (n > 0 && checkpoint_write(path, &header, records) == -1)
+			pexit("checkpoint_write");
 	}
+	pthread_mutex_unlock(&lock);
 
-	/* the state should be reversed on every iteration in order to generate
-	 * a palindrome */
-	reverse(state);
+	free(records);
 }
 
+/* sets up a worker to write its committed words to spool files next to
+ * `outfile`, keeping only the last SEARCH_HORIZON moves in memory. When
+ * `resumed`, the spools are taken back to where they were at the checkpoint. */
 static int
-print_palindrome(const char *word, char *article, long pos, long total)
+stream_worker(struct worker *w, const char *outfile, const struct checkpoint_streams *resumed)
 {
-	char prefix[3];
-
-	/* for the first word in the palindrome, the article should be uppercased,
-	 * and not prefixed with a comma; in case it is the last word (Panama), there
-	 * should be no comma, but a dash instead. */
-	if (pos == 0) {
-		article[0] = toupper(article[0]);
-		prefix[0] = '\0';
-	} else if (pos == total - 1) {
-		strncpy(prefix, " -", 3);
-	} else {
-		strncpy(prefix, ", ", 3);
-	}
+	int fd, flags = O_RDWR | O_CREAT | (resumed ? 0 : O_TRUNC);
+
+	snprintf(w->left_path, PATH_MAX, "%s.%d.left", outfile, w->stream_id);
+	snprintf(w->right_path, PATH_MAX, "%s.%d.right", outfile, w->stream_id);
 
-	printf("%s", prefix);
-	if (pos != total - 1)
-		printf("%s", article);
-	printf(" %s", word);
+	if ((fd = open(w->left_path, flags, 0644)) == -1 ||
+			output_init(&w->left, fd, false) == -1)
+		return -1;
 
-	/* end with an exciting exclamation mark! */
-	if (pos == total - 1)
-		printf("!");
+	if ((fd = open(w->right_path, flags, 0644)) == -1 ||
+			output_init(&w->right, fd, true) == -1)
+		return -1;
+
+	if (resumed) {
+		if (ftruncate(w->left.fd, resumed->left_offset) == -1 ||
+				lseek(w->left.fd, resumed->left_offset, SEEK_SET) == -1 ||
+				ftruncate(w->right.fd, resumed->right_offset) == -1 ||
+				lseek(w->right.fd, resumed->right_offset, SEEK_SET) == -1)
+			return -1;
+
+		w->left.written = resumed->left_written;
+		w->right.written = resumed->right_written;
+	}
 
+	search_stream(&w->search, SEARCH_HORIZON, spill_word, w);
 	return 0;
 }
 
-static void
-usage()
+/* the first word spilled to the left is the first of the palindrome, and
+ * the first one spilled to the right is the last */
+static int
+spill_word(const char *word, enum palindrome_direction side, void *data)
 {
-	fprintf(stderr, "Usage: %s <nouns_list> [<palindrome_size>]\n", progname);
-	exit(EXIT_FAILURE);
+	struct worker *w = data;
+
+	if (side == LEFT)
+		return output_word(&w->left, word, w->left.written == 0, false);
+
+	return output_word(&w->right, word, false, w->right.written == 0);
 }
 
-static bool
-is_palindrome(const char *word)
+/* writes the words of the palindrome kept in memory by the search `s` to `o`.
+ * If nothing was written to `o` before, the first word starts the sentence. */
+static int
+write_palindrome(struct output *o, struct search *s)
 {
-	size_t len = strlen(word);
-	size_t i, j;
-
-	i = 0; j = len - 1;
-	while (i < j) {
-		if (word[i] != word[j])
-			return false;
+	/* once the first right move is committed, the last word is spooled */
+	return output_words(o, &s->palindrome, o->written == 0, s->committed < 2);
+}
 
-		++i; --j;
+/* completes the streamed palindrome of the winner worker: the middle part,
+ * still in memory, is written after its left half, followed by the right half
+ * in reverse; the result is moved to `outfile`. Spool files of the other
+ * workers are just removed. */
+static int
+finish_stream(struct worker *w, const char *outfile, bool keep)
+{
+	int retval = 0;
+
+	if (keep) {
+		if (write_palindrome(&w->left, &w->search) == -1 ||
+				output_flush(&w->right) == -1 ||
+				output_reverse(&w->left, w->right.fd) == -1 ||
+				output_write(&w->left, "\n", 1) == -1 ||
+				output_flush(&w->left) == -1 ||
+				rename(w->left_path, outfile) == -1)
+			retval = -1;
+	} else {
+		unlink(w->left_path);
 	}
 
-	return true;
+	unlink(w->right_path);
+	output_destroy(&w->left);
+	output_destroy(&w->right);
+	close(w->left.fd);
+	close(w->right.fd);
+
+	return retval;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: %s [-c <entries>] [-g] [-j <workers>] [-k <checkpoint> [--resume]] [-m <metrics>] [-o <file>] [-s <seed>] [-u]"
+			" <nouns_list> [<palindrome_size>]\n", progname);
+	fprintf(stderr, "       %s -d <socket> [-c <entries>] [-g] [-j <workers>] [-m <metrics>] [-u] <nouns_list>\n", progname);
+	exit(EXIT_FAILURE);
 }
 
 static long
@@ -312,6 +694,38 @@ palindrome_size(const char *arg)
 	}
 }
 
+static long
+workers_count(const char *arg)
+{
+	long n;
+	char *endptr;
+
+	n = strtol(arg, &endptr, 10);
+	if (endptr == arg || *endptr != '\0' || n <= 0) {
+		fprintf(stderr, "%s: %s: invalid number of workers (must be > 0)\n", progname, arg);
+		exit(EXIT_FAILURE);
+	}
+
+	return n;
+}
+
+static long
+cache_entries(const char *arg)
+{
+	long n;
+	char *endptr;
+
+	errno = 0;
+	n = strtol(arg, &endptr, 10);
+	if (endptr == arg || *endptr != '\0' || n < 0 || n > CANDIDATE_CACHE_MAX_ENTRIES || errno == ERANGE) {
+		fprintf(stderr, "%s: %s: invalid number of cache entries (must be between 0 and %ld)\n", progname, arg,
+				CANDIDATE_CACHE_MAX_ENTRIES);
+		exit(EXIT_FAILURE);
+	}
+
+	return n;
+}
+
 static void
 pexit(const char *fname)
 {
@@ -0,0 +1,698 @@
+#include "search.h"
+#include "log.h"
+
+static bool left_selector(const char *word, char *article, void *data);
+static bool right_selector(const char *word, char *article, void *data);
+static bool (*word_selector(enum palindrome_direction dir))(const char *word, char *article, void *data);
+static long lookup(struct search *s, char *curword, char *article);
+static long candidates(struct search *s, const uint64_t *skip, long *ids, bool *complete);
+static int spans_of(struct search *s, struct word_list_span *spans);
+static bool steering(const struct search *s);
+static bool viable(struct search *s, const char *token);
+static void next_state(const char *state, enum palindrome_direction direction, const char *token, char *next);
+static void change_state(struct search *s, const char *word, const char *article);
+static void rollback(struct search *s);
+static void update_distance(struct search *s);
+static int commit(struct search *s);
+static int trail_push(struct search *s, long id);
+static long room(const struct search *s);
+static void reverse(char *word);
+
+int
+search_init(struct search *s, struct word_list *nouns, struct state_graph *graph, struct candidate_cache *cache,
+		long size, unsigned int seed)
+{
+	return search_init_with(s, nouns, graph, cache, size, seed, NULL);
+}
+
+int
+search_init_with(struct search *s, struct word_list *nouns, struct state_graph *graph, struct candidate_cache *cache,
+		long size, unsigned int seed, struct allocator *alloc)
+{
+	if (s == NULL || nouns == NULL || size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* words come and go with every step and rollback: once the pool has
+	 * grown to the largest palindrome seen, they take no heap traffic. The
+	 * list only holds the starting words until the first step, when it is
+	 * known whether the search streams (see `room`). */
+	if (pool_allocator_init(&s->pool, alloc, WORD_LIST_LARGEST_NOUN, SEARCH_POOL_CHUNK) == -1 ||
+			word_list_init_with(&s->palindrome, SEARCH_START_WORDS, &s->pool.base) == -1)
+		return -1;
+
+	/* "A man, a plan, a canal - Panama!" */
+	word_list_append(&s->palindrome, "man");
+	word_list_append(&s->palindrome, "plan");
+	word_list_append(&s->palindrome, "canal");
+	word_list_append(&s->palindrome, "Panama");
+
+	s->nouns = nouns;
+	strncpy(s->state, "aca", 4);
+	s->direction = LEFT;
+	s->curpos = 2; /* first added word should be at the left of position 2 */
+	s->total = SEARCH_START_WORDS;
+	s->moves = 0;
+	s->size = size;
+	s->seed = seed;
+	s->graph = graph;
+	s->cache = cache;
+	s->horizon = 0;
+	s->committed = 0;
+	s->lead = 2; /* "man", "plan" */
+	s->tail = 2; /* "canal", "Panama" */
+	s->spill = NULL;
+	s->spill_data = NULL;
+	s->trail = NULL;
+	s->trail_start = 0;
+	s->trail_size = 0;
+	s->used = NULL;
+	memset(&s->counters, 0, sizeof(s->counters));
+	s->distance = STATE_GRAPH_UNKNOWN;
+	update_distance(s);
+
+	return 0;
+}
+
+int
+search_step(struct search *s)
+{
+	char curword[WORD_LIST_LARGEST_NOUN], article[3];
+	long id;
+
+	if ((id = lookup(s, curword, article)) == -1) {
+		/* nothing fits the current state: undo the last move, if any, and
+		 * let the random choice take another path from there */
+		if (s->moves == s->committed)
+			return -1;
+
+		rollback(s);
+		METRICS_INC(&s->counters, rollbacks);
+		return 0;
+	}
+
+	if (s->palindrome.size < room(s) && word_list_resize(&s->palindrome, room(s)) == -1)
+		return -1;
+
+	if (word_list_add_at(&s->palindrome, curword, s->curpos) == -1 || trail_push(s, id) == -1)
+		return -1;
+
+	if (s->used != NULL)
+		WORD_LIST_BIT_SET(s->used, id);
+
+	change_state(s, curword, article);
+
+	/* left words keep accumulating at the left of `curpos`; right words are
+	 * placed exactly at it, pushing the previous right words further */
+	if (s->direction == LEFT)
+		++s->curpos;
+
+	++s->total;
+	++s->moves;
+	s->direction = (s->direction == LEFT ? RIGHT : LEFT);
+	update_distance(s);
+
+	if (s->spill != NULL && s->moves - s->committed > s->horizon && commit(s) == -1)
+		return -1;
+
+	METRICS_INC(&s->counters, words_added);
+	log_debug("After loop: word=%s article=%s state=%s direction=%s position=%ld total=%ld", curword, article, s->state, s->direction == LEFT ? "LEFT" : "RIGHT", s->curpos, s->total);
+
+	return 0;
+}
+
+void
+search_starting_words(const struct word_list *nouns, uint64_t *used)
+{
+	/* the dictionary is lowercase, as is the last word once compared */
+	static const char *starting[SEARCH_START_WORDS] = { "man", "plan", "canal", "panama" };
+	struct word_list_span span;
+	long i, j, id, cursor;
+
+	for (j = 0; j < SEARCH_START_WORDS; ++j) {
+		if (word_list_exact(nouns, starting[j], &span) == -1)
+			break;
+
+		for (cursor = 0; (id = word_list_span_next(&span, NULL, &cursor)) != -1; )
+			WORD_LIST_BIT_SET(used, id);
+	}
+
+	if (j == SEARCH_START_WORDS)
+		return;
+
+	/* not indexed: scan the whole list */
+	for (i = 0; i < nouns->num_words; ++i)
+		for (j = 0; j < SEARCH_START_WORDS; ++j)
+			if (strcmp(WORD_LIST_WORD(nouns, i), starting[j]) == 0)
+				WORD_LIST_BIT_SET(used, i);
+}
+
+int
+search_unique(struct search *s)
+{
+	s->used = calloc(WORD_LIST_BLOCKS(s->nouns->num_words), sizeof(uint64_t));
+	if (s->used == NULL)
+		return -1;
+
+	/* the words of the starting palindrome may be in the dictionary too */
+	search_starting_words(s->nouns, s->used);
+	return 0;
+}
+
+int
+search_unique_from(struct search *s, const uint64_t *initial)
+{
+	size_t len = WORD_LIST_BLOCKS(s->nouns->num_words) * sizeof(uint64_t);
+
+	s->used = malloc(len);
+	if (s->used == NULL)
+		return -1;
+
+	memcpy(s->used, initial, len);
+	return 0;
+}
+
+void
+search_stream(struct search *s, long horizon, int (*spill)(const char *word, enum palindrome_direction side, void *data),
+		void *data)
+{
+	s->horizon = horizon;
+	s->spill = spill;
+	s->spill_data = data;
+}
+
+int
+search_replay(struct search *s)
+{
+	long i, n, m;
+
+	while (s->palindrome.num_words > 0)
+		word_list_remove_at(&s->palindrome, s->palindrome.num_words - 1);
+
+	if (s->lead > 0) {
+		word_list_append(&s->palindrome, "man");
+		word_list_append(&s->palindrome, "plan");
+	}
+
+	if (s->tail > 0) {
+		word_list_append(&s->palindrome, "canal");
+		word_list_append(&s->palindrome, "Panama");
+	}
+
+	n = s->moves - s->committed;
+	s->curpos = s->lead;
+
+	/* the moves kept in memory, and the starting words, fit in the room
+	 * the search had when they were made */
+	if (s->palindrome.size < n + SEARCH_START_WORDS && word_list_resize(&s->palindrome, n + SEARCH_START_WORDS) == -1)
+		return -1;
+
+	for (i = 0; i < n; ++i) {
+		if (s->trail[s->trail_start + i] < 0 || s->trail[s->trail_start + i] >= s->nouns->num_words) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (word_list_add_at(&s->palindrome, WORD_LIST_WORD(s->nouns, s->trail[s->trail_start + i]), s->curpos) == -1)
+			return -1;
+
+		/* odd moves are to the left */
+		m = s->committed + i + 1;
+		if (m % 2 == 1)
+			++s->curpos;
+	}
+
+	update_distance(s);
+	return 0;
+}
+
+bool
+search_done(const struct search *s)
+{
+	return s->total >= s->size && state_is_palindrome(s->state);
+}
+
+int
+search_run(struct search *s, atomic_bool *stop)
+{
+	return search_run_until(s, stop, NULL);
+}
+
+int
+search_run_until(struct search *s, atomic_bool *stop, const struct timespec *deadline)
+{
+	struct timespec now;
+	long steps;
+
+	for (steps = 0; !search_done(s); ++steps) {
+		if (stop != NULL && atomic_load_explicit(stop, memory_order_relaxed))
+			return 1;
+
+		/* the clock is only looked at every so often */
+		if (deadline != NULL && steps % SEARCH_CLOCK_STEPS == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > deadline->tv_sec ||
+					(now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec))
+				return 2;
+		}
+
+		if (search_step(s) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+search_destroy(struct search *s)
+{
+	if (s == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	free(s->trail);
+	free(s->used);
+	if (word_list_destroy(&s->palindrome) == -1)
+		return -1;
+
+	return pool_allocator_destroy(&s->pool);
+}
+
+/* left words are appended to the left half of the palindrome: the article
+ * and the word must start with the letters the left half is missing. */
+static bool
+left_selector(const char *word, char *article, void *data)
+{
+	struct search *s = data;
+	char comparable[WORD_LIST_LARGEST_NOUN + 3];
+
+	METRICS_INC(&s->counters, selector_calls);
+	snprintf(comparable, sizeof(comparable), "%s%s", article, word);
+
+	return (strncmp(comparable, s->state, strlen(s->state)) == 0) && viable(s, comparable);
+}
+
+/* right words are prepended to the right half of the palindrome, and must
+ * therefore end with the letters the right half is missing. */
+static bool
+right_selector(const char *word, char *article, void *data)
+{
+	struct search *s = data;
+	char comparable[WORD_LIST_LARGEST_NOUN + 3];
+	size_t comparable_len, state_len;
+
+	METRICS_INC(&s->counters, selector_calls);
+	snprintf(comparable, sizeof(comparable), "%s%s", article, word);
+	comparable_len = strlen(comparable);
+	state_len = strlen(s->state);
+
+	if (comparable_len < state_len)
+		return false;
+
+	/* a word that matches the state exactly closes the gap */
+	if (comparable_len == state_len)
+		return strcmp(comparable, s->state) == 0 && viable(s, comparable);
+
+	/* otherwise, we have to make sure that the letters left over end with 'a',
+	 * since they will be matched by the next left word, and an article
+	 * ('a' or 'an') precedes every word. */
+	return (comparable[comparable_len - state_len - 1] == 'a' &&
+			strcmp(&(comparable[comparable_len - state_len]), s->state) == 0 &&
+			viable(s, comparable));
+}
+
+static bool
+(*word_selector(enum palindrome_direction dir))(const char *word, char *article, void *data)
+{
+	return dir == LEFT ? left_selector : right_selector;
+}
+
+/* chooses a random word that fits the current state, copying it to `curword`
+ * alongside its `article`. Returns the word position in the dictionary, or
+ * -1 if no word fits. */
+static long
+lookup(struct search *s, char *curword, char *article)
+{
+	long ids[WORD_LIST_LOOKUP_RSET], num_ids, idx, i;
+	struct candidate_entry *e;
+	bool complete;
+
+	METRICS_INC(&s->counters, lookups);
+
+	/* the words accepted while steering to a closure depend on more than
+	 * the state, so they are never cached */
+	if (s->cache == NULL || steering(s)) {
+		num_ids = candidates(s, s->used, ids, NULL);
+		METRICS_ADD(&s->counters, candidates, num_ids);
+		if (num_ids == 0)
+			return -1;
+
+		idx = ids[rand_r(&s->seed) % num_ids];
+	} else {
+		e = candidate_cache_get(s->cache, s->state, s->direction);
+		if (e == NULL) {
+			num_ids = candidates(s, NULL, ids, &complete);
+			METRICS_ADD(&s->counters, candidates, num_ids);
+			e = candidate_cache_put(s->cache, s->state, s->direction, ids, num_ids, complete);
+		}
+
+		/* cached candidates ignore which words are used, as that changes
+		 * with every move */
+		for (i = num_ids = 0; i < e->num_ids; ++i)
+			if (s->used == NULL || !WORD_LIST_BIT_TEST(s->used, e->ids[i]))
+				ids[num_ids++] = e->ids[i];
+
+		/* the scan that filled the entry may have stopped before the end
+		 * of the dictionary: look further into it before giving up */
+		if (num_ids == 0 && !e->complete) {
+			num_ids = candidates(s, s->used, ids, NULL);
+			METRICS_ADD(&s->counters, candidates, num_ids);
+		}
+
+		if (num_ids == 0)
+			return -1;
+
+		idx = ids[rand_r(&s->seed) % num_ids];
+	}
+
+	strncpy(curword, WORD_LIST_WORD(s->nouns, idx), WORD_LIST_LARGEST_NOUN);
+	word_list_article(curword, article);
+
+	return idx;
+}
+
+/* collects the words that fit the current state, as `word_list_select_except`
+ * does, but only among the words the dictionary indexes give for the state:
+ * the selector is only asked about words that start (or end) with the right
+ * letters, and used words (in `skip`) are passed over without being looked
+ * at. Unindexed dictionaries are scanned as a whole. */
+static long
+candidates(struct search *s, const uint64_t *skip, long *ids, bool *complete)
+{
+	struct word_list_span spans[3];
+	char article[3];
+	const char *word;
+	long nchosen = 0, tries = 0, cursor, id;
+	uint32_t need = 0;
+	int nspans, i;
+
+	if ((nspans = spans_of(s, spans)) == -1)
+		return word_list_select_except(s->nouns, word_selector(s->direction), s, skip, ids, complete);
+
+	/* a right word that ends with the state, and is not the state itself,
+	 * needs an 'a' just before it (see `right_selector`): when the state
+	 * has none, words whose signature has none either are passed over */
+	if (s->direction == RIGHT && s->nouns->signatures != NULL &&
+			(word_list_signature(s->state) & WORD_LIST_LETTER('a')) == 0)
+		need = WORD_LIST_LETTER('a');
+
+	/* the same limits as a scan of the whole dictionary */
+	for (i = 0; i < nspans; ++i) {
+		cursor = 0;
+		while (nchosen < WORD_LIST_LOOKUP_RSET && tries < WORD_LIST_LOOKUP_TRIES &&
+				(id = word_list_span_next(&spans[i], skip, &cursor)) != -1) {
+			word = WORD_LIST_WORD(s->nouns, id);
+			if (i == 0 && need != 0 && (s->nouns->signatures[id] & need) == 0 && strcmp(word, s->state) != 0) {
+				METRICS_INC(&s->counters, signature_skips);
+			} else {
+				word_list_article(word, article);
+				if (word_selector(s->direction)(word, article, s))
+					ids[nchosen++] = id;
+			}
+
+			if (nchosen > 0)
+				++tries;
+		}
+
+		if (cursor < spans[i].count)
+			break;
+	}
+
+	if (complete != NULL)
+		*complete = (i == nspans);
+
+	return nchosen;
+}
+
+/* finds the spans of the dictionary holding every word that may fit the
+ * current state once preceded by its article ("a" or "an"):
+ *
+ * 	left:  the words starting with the state, minus an article it starts
+ * 	       with (the two prefixes overlap when one begins the other: only
+ * 	       the shorter one is kept)
+ * 	right: the words ending with the state, and the words shorter than the
+ * 	       state that the article makes up for, i.e., the state without its
+ * 	       first one or two letters
+ *
+ * Returns the number of spans, or -1 if the dictionary is not indexed. */
+static int
+spans_of(struct search *s, struct word_list_span *spans)
+{
+	static const char *articles[] = { "a", "an" };
+	const char *prefixes[2];
+	size_t statelen = strlen(s->state), len;
+	int n = 0, i;
+
+	if (s->direction == RIGHT) {
+		if (word_list_suffix(s->nouns, s->state, &spans[n++]) == -1)
+			return -1;
+
+		for (i = 1; i <= 2 && (size_t) i < statelen; ++i)
+			if (word_list_exact(s->nouns, &(s->state[i]), &spans[n++]) == -1)
+				return -1;
+
+		return n;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		len = strlen(articles[i]);
+		if (strncmp(s->state, articles[i], statelen < len ? statelen : len) != 0)
+			continue;
+
+		prefixes[n++] = statelen > len ? &(s->state[len]) : "";
+	}
+
+	if (n == 2 && strncmp(prefixes[0], prefixes[1], strlen(prefixes[1])) == 0)
+		prefixes[0] = prefixes[--n];
+	else if (n == 2 && strncmp(prefixes[0], prefixes[1], strlen(prefixes[0])) == 0)
+		--n;
+
+	for (i = 0; i < n; ++i)
+		if (word_list_prefix(s->nouns, prefixes[i], &spans[i]) == -1)
+			return -1;
+
+	return n;
+}
+
+/* whether the search is past its target size, and heading to the closest
+ * palindromic state */
+static bool
+steering(const struct search *s)
+{
+	return s->graph != NULL && s->total >= s->size && s->distance >= 0;
+}
+
+/* decides, based on the closure graph, whether adding `token` (an article
+ * followed by a word that fits the current state) is worth trying: it must
+ * not lead to a dead end and, once the palindrome is large enough, it must
+ * take the state closer to a palindromic one. */
+static bool
+viable(struct search *s, const char *token)
+{
+	char next[WORD_LIST_LARGEST_NOUN];
+	long d;
+
+	if (s->graph == NULL)
+		return true;
+
+	next_state(s->state, s->direction, token, next);
+	d = state_graph_distance(s->graph, next, s->direction == LEFT ? RIGHT : LEFT);
+
+	if (d == STATE_GRAPH_DEAD)
+		return false;
+
+	if (steering(s))
+		return d >= 0 && d < s->distance;
+
+	return true;
+}
+
+/* computes the state that results from adding `token` to the palindrome in
+ * the given direction: the current state is removed from the token, according
+ * to the direction that it is being added to the palindrome, and the rest is
+ * reversed */
+static void
+next_state(const char *state, enum palindrome_direction direction, const char *token, char *next)
+{
+	size_t statelen = strlen(state),
+	       tokenlen = strlen(token);
+
+	if (direction == LEFT) {
+		/* state will be same as token, after removing the first letters,
+		 * according to the current state length */
+		snprintf(next, WORD_LIST_LARGEST_NOUN, "%s", &(token[statelen]));
+	} else {
+		/* in a similar logic, the new state should be equal to `token`,
+		 * after removing as many letters as we currently have on state */
+		snprintf(next, WORD_LIST_LARGEST_NOUN, "%.*s", (int) (tokenlen - statelen), token);
+	}
+
+	/* the state should be reversed on every iteration in order to generate
+	 * a palindrome */
+	reverse(next);
+}
+
+/* changes the algorithm `state` after `word` is added to the palindrome */
+static void
+change_state(struct search *s, const char *word, const char *article)
+{
+	size_t n = WORD_LIST_LARGEST_NOUN + 3; /* account for article size */
+	char token[n], next[WORD_LIST_LARGEST_NOUN];
+
+	snprintf(token, n, "%s%s", article, word);
+	next_state(s->state, s->direction, token, next);
+	strncpy(s->state, next, WORD_LIST_LARGEST_NOUN);
+}
+
+/* undoes the last move. Directions always alternate, so the last word is the
+ * one at the side opposite to the current direction, and the previous state
+ * can be derived from that word and the current state. */
+static void
+rollback(struct search *s)
+{
+	size_t n = WORD_LIST_LARGEST_NOUN + 3,
+	       statelen = strlen(s->state),
+	       tokenlen;
+	char token[n], article[3];
+	enum palindrome_direction last = (s->direction == LEFT ? RIGHT : LEFT);
+	long pos = (last == LEFT ? s->curpos - 1 : s->curpos);
+
+	word_list_article(s->palindrome.words[pos], article);
+	snprintf(token, n, "%s%s", article, s->palindrome.words[pos]);
+	tokenlen = strlen(token);
+
+	if (last == LEFT) {
+		/* the state was the beginning of the token */
+		token[tokenlen - statelen] = '\0';
+		snprintf(s->state, WORD_LIST_LARGEST_NOUN, "%s", token);
+		--s->curpos;
+	} else {
+		/* the state was the end of the token */
+		snprintf(s->state, WORD_LIST_LARGEST_NOUN, "%s", &(token[statelen]));
+	}
+
+	if (s->used != NULL)
+		WORD_LIST_BIT_CLEAR(s->used, s->trail[s->trail_start + s->moves - s->committed - 1]);
+
+	word_list_remove_at(&s->palindrome, pos);
+	--s->total;
+	--s->moves; /* which also drops it from the trail */
+	s->direction = last;
+	update_distance(s);
+}
+
+/* hands the oldest move over to the `spill` function, together with the
+ * starting words that precede it (on the left half) or follow it (on the
+ * right half), and removes them from the palindrome. Moves alternate and the
+ * first one is to the left, so odd moves are left ones. */
+static int
+commit(struct search *s)
+{
+	long i, n;
+
+	if ((s->committed + 1) % 2 == 1) {
+		for (i = 0; i <= s->lead; ++i)
+			if (s->spill(s->palindrome.words[i], LEFT, s->spill_data) == -1)
+				return -1;
+
+		for (i = 0; i <= s->lead; ++i)
+			word_list_remove_at(&s->palindrome, 0);
+
+		s->curpos -= s->lead + 1;
+		s->lead = 0;
+	} else {
+		/* the right half is spilled from the end of the palindrome */
+		n = s->palindrome.num_words;
+		for (i = n - 1; i >= n - 1 - s->tail; --i)
+			if (s->spill(s->palindrome.words[i], RIGHT, s->spill_data) == -1)
+				return -1;
+
+		for (i = n - 1; i >= n - 1 - s->tail; --i)
+			word_list_remove_at(&s->palindrome, i);
+
+		s->tail = 0;
+	}
+
+	++s->committed;
+	++s->trail_start;
+	return 0;
+}
+
+/* appends the dictionary position of a new move to the trail. Committed moves
+ * are dropped from the beginning of the trail lazily, when it is full. */
+static int
+trail_push(struct search *s, long id)
+{
+	long n = s->moves - s->committed;
+	void *p;
+
+	if (s->trail_start + n == s->trail_size) {
+		if (s->trail_start > s->trail_size / 2) {
+			memmove(s->trail, &(s->trail[s->trail_start]), n * sizeof(long));
+			s->trail_start = 0;
+		} else {
+			p = realloc(s->trail, (s->trail_size ? 2 * s->trail_size : 1024) * sizeof(long));
+			if (p == NULL)
+				return -1;
+
+			s->trail = p;
+			s->trail_size = s->trail_size ? 2 * s->trail_size : 1024;
+		}
+	}
+
+	s->trail[s->trail_start + n] = id;
+	return 0;
+}
+
+/* words the palindrome list must have room for: a streaming search keeps the
+ * starting words and at most `horizon` moves, plus the one that just made it
+ * commit; other searches keep everything, which is given plenty of room */
+static long
+room(const struct search *s)
+{
+	if (s->spill != NULL)
+		return s->horizon + SEARCH_START_WORDS + 1;
+
+	return 100 * s->size;
+}
+
+static void
+update_distance(struct search *s)
+{
+	if (s->graph != NULL)
+		s->distance = state_graph_distance(s->graph, s->state, s->direction);
+}
+
+/* reverses a string in place */
+static void
+reverse(char *word)
+{
+	size_t len = strlen(word),
+	       i, j;
+	char c;
+
+	if (len == 0)
+		return;
+
+	i = 0; j = len - 1;
+
+	while (i < j) {
+		c = word[j];
+		word[j] = word[i];
+		word[i] = c;
+
+		++i; --j;
+	}
+}
@@ -0,0 +1,159 @@
+/* search - the palindrome generation state machine, isolated from the
+ * command line program so that several independent searches can run at
+ * the same time over a single, shared, dictionary. */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdatomic.h>
+#include <time.h>
+
+#include "word_list.h"
+#include "state_graph.h"
+#include "candidate_cache.h"
+#include "metrics.h"
+
+/* number of moves kept in memory (and that can be rolled back) by a
+ * streaming search */
+#ifndef SEARCH_HORIZON
+#  define SEARCH_HORIZON (4096)
+#endif
+
+/* words of the starting palindrome, "A man, a plan, a canal - Panama!" */
+#define SEARCH_START_WORDS (4)
+
+/* steps taken by `search_run_until` between two looks at the clock */
+#ifndef SEARCH_CLOCK_STEPS
+#  define SEARCH_CLOCK_STEPS (64)
+#endif
+
+/* words of the palindrome taken from the heap at once */
+#ifndef SEARCH_POOL_CHUNK
+#  define SEARCH_POOL_CHUNK (256)
+#endif
+
+struct search {
+	struct word_list *nouns;      /* shared dictionary: never modified by the search */
+	struct word_list palindrome;  /* the palindrome under construction */
+	struct pool_allocator pool;   /* of the words in `palindrome` */
+
+	/* the part that does not fit the palindrome yet */
+	char state[WORD_LIST_LARGEST_NOUN];
+	enum palindrome_direction direction;
+
+	long curpos; /* words at the left of `curpos` belong to the left half */
+	long total;  /* number of words in the palindrome */
+	long moves;  /* number of words added on top of the starting palindrome */
+	long size;   /* target palindrome size */
+
+	unsigned int seed; /* private PRNG state, to be used with `rand_r(3)` */
+
+	/* optional, shared, closure graph: when given, words that lead to dead
+	 * end states are never chosen and, once the target size is reached, only
+	 * words that get closer to a palindromic state are */
+	struct state_graph *graph;
+	long distance; /* distance of `state` to a closure, according to `graph` */
+
+	/* optional, private, cache of the words that fit each state */
+	struct candidate_cache *cache;
+
+	/* streaming: once more than `horizon` moves are kept in memory, the
+	 * oldest one is committed (it can no longer be rolled back) and its
+	 * words are handed to `spill` and dropped from `palindrome` */
+	long horizon;
+	long committed; /* number of moves committed so far */
+	long lead;      /* starting words still at the beginning of `palindrome` */
+	long tail;      /* starting words still at the end of `palindrome` */
+	int (*spill)(const char *word, enum palindrome_direction side, void *data);
+	void *spill_data;
+
+	/* dictionary positions of the words added by the moves that were not
+	 * committed yet, in the order they were made. They start at
+	 * `trail[trail_start]` and there are `moves - committed` of them. */
+	long *trail;
+	long trail_start, trail_size;
+
+	/* when not NULL, the dictionary positions of every word in the
+	 * palindrome, including the committed ones: such words are never
+	 * chosen again */
+	uint64_t *used;
+
+	struct metrics_counters counters;
+};
+
+/* initializes a search for a palindrome of at least `size` words, built from
+ * words in the `nouns` list. The search starts from the short default of
+ * "A man, a plan, a canal - Panama!". Each search has its own random number
+ * generator, seeded with `seed`, so that concurrent searches explore different
+ * branches. The closure `graph`, built from the same `nouns`, and the
+ * candidate `cache`, which must not be shared with other searches, may be
+ * NULL.
+ *
+ * Returns a positive number on success, -1 on error */
+int search_init(struct search *s, struct word_list *nouns, struct state_graph *graph, struct candidate_cache *cache,
+		long size, unsigned int seed);
+
+/* same as `search_init`, but the pool of the palindrome takes its memory from
+ * `alloc` (the system allocator if NULL), which must outlive the search */
+int search_init_with(struct search *s, struct word_list *nouns, struct state_graph *graph, struct candidate_cache *cache,
+		long size, unsigned int seed, struct allocator *alloc);
+
+/* performs a single step of the search: either a new word is added to the
+ * palindrome or, in case no word fits the current state, the last added word
+ * is rolled back.
+ *
+ * Returns 0 on success, or -1 in case there is nothing left to roll back (that
+ * is, no palindrome can be built from the given nouns). */
+int search_step(struct search *s);
+
+/* makes the search use each noun at most once. Note that the closure graph
+ * assumes words can be repeated, so the search may now run into dead ends it
+ * has to roll back from.
+ *
+ * Returns a positive number on success, -1 on error */
+int search_unique(struct search *s);
+
+/* sets the bits of `used`, a bitset with a bit for each of the `nouns`, of
+ * the nouns that are words of the starting palindrome. Indexed lists are
+ * looked up; others are scanned. */
+void search_starting_words(const struct word_list *nouns, uint64_t *used);
+
+/* same as `search_unique`, but the words already used are copied from
+ * `initial`, as set by `search_starting_words` for the same nouns, so that
+ * many searches over a list do not look them up again.
+ *
+ * Returns a positive number on success, -1 on error */
+int search_unique_from(struct search *s, const uint64_t *initial);
+
+/* makes the search keep only the last `horizon` moves in memory. Words of
+ * older moves are given to `spill`, along with `data`: words of the left half
+ * in the order they appear on the palindrome, and words of the right half in
+ * reverse order (from the last word of the palindrome towards the middle).
+ * The spilled words can no longer be rolled back. */
+void search_stream(struct search *s, long horizon, int (*spill)(const char *word, enum palindrome_direction side, void *data),
+		void *data);
+
+/* rebuilds the palindrome kept in memory from the `trail`, and the `lead`
+ * and `tail` starting words, after these were restored (e.g., from a
+ * checkpoint). `moves`, `committed`, `state` and `used` must be restored as
+ * well.
+ *
+ * Returns a positive number on success, -1 on error */
+int search_replay(struct search *s);
+
+/* whether the search has reached a palindrome of the target size */
+bool search_done(const struct search *s);
+
+/* steps the search until it is done, or until `stop` (if given) is set by
+ * someone else. Returns 0 when a palindrome is found, 1 when the search was
+ * stopped, or -1 on failure. */
+int search_run(struct search *s, atomic_bool *stop);
+
+/* same as `search_run`, but gives up once the CLOCK_MONOTONIC time reaches
+ * `deadline` (if given), returning 2. */
+int search_run_until(struct search *s, atomic_bool *stop, const struct timespec *deadline);
+
+/* releases the resources used by the search. The nouns list is not touched. */
+int search_destroy(struct search *s);
+
+#endif /* SEARCH_H */
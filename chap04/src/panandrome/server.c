@@ -0,0 +1,506 @@
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "candidate_cache.h"
+#include "search.h"
+#include "output.h"
+#include "log.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* longest request line accepted */
+#define REQUEST_MAXLEN (256)
+
+/* what each thread owns: requests are answered without any locking */
+struct server_worker {
+	pthread_t thread;
+	struct server *server;
+	struct candidate_cache cache;
+	unsigned long generation; /* of the nouns list the cache was filled from */
+
+	/* the connection being answered, or -1. It is shut down by the thread
+	 * stopping the server, so that the worker does not wait for the client. */
+	int conn;
+	pthread_mutex_t lock; /* guards `conn` */
+};
+
+/* what goes along with each snapshot of the nouns list, built once when it
+ * is loaded rather than for every request */
+struct server_extras {
+	struct state_graph *graph; /* NULL unless the search is pruned */
+	uint64_t *starting;        /* nouns in the starting palindrome (see `search_starting_words`) */
+};
+
+static struct word_list_snapshot *load(struct server *s);
+static void reload(struct server *s);
+static void release_extras(void *data);
+static int start_workers(struct server *s, struct server_worker *workers);
+static void stop_workers(struct server *s, struct server_worker *workers, long n);
+static void *serve(void *arg);
+static int watch(struct server_worker *w, int fd);
+static void forget(struct server_worker *w);
+static void serve_connection(struct server_worker *w, int fd);
+static int answer(struct server_worker *w, struct output *o, char *request);
+static int reply_error(struct output *o, const char *reason);
+static int parse_request(char *request, long *size, unsigned int *seed);
+static void report(struct server *s, struct server_worker *workers, struct metrics *m, FILE *f);
+
+int
+server_run(struct server *s, struct metrics *m, FILE *metrics_file)
+{
+	ErrorCase(s == NULL || s->path == NULL || s->nouns_path == NULL || s->nworkers <= 0, EINVAL, -1);
+
+	struct word_list_snapshot *snap;
+	struct sockaddr_un addr;
+	struct server_worker *workers;
+	sigset_t set;
+	int sig, err;
+
+	ErrorCase(strlen(s->path) >= sizeof(addr.sun_path), ENAMETOOLONG, -1);
+
+	metrics_begin(m, PHASE_LOAD);
+	snap = load(s);
+	ErrorCase(snap == NULL, errno, -1);
+	ErrorCase(word_list_slot_init(&s->nouns, snap) == -1, errno, -1);
+	metrics_end(m, PHASE_LOAD);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, s->path, sizeof(addr.sun_path) - 1);
+
+	s->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	ErrorCase(s->fd == -1, errno, -1);
+
+	unlink(s->path);
+	if (bind(s->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(s->fd, SOMAXCONN) == -1) {
+		err = errno;
+		close(s->fd);
+		errno = err;
+		return -1;
+	}
+
+	atomic_init(&s->stop, false);
+	atomic_init(&s->served, 0);
+	atomic_init(&s->failed, 0);
+	memset(&s->total, 0, sizeof(s->total));
+
+	/* signals are only taken by this thread, with `sigwait`: the workers
+	 * inherit the mask. Clients that go away must not kill the server. */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGHUP);
+	sigaddset(&set, SIGUSR1);
+	if ((err = pthread_sigmask(SIG_BLOCK, &set, NULL)) != 0) {
+		errno = err;
+		return -1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	workers = calloc(s->nworkers, sizeof(struct server_worker));
+	ErrorCase(workers == NULL, errno, -1);
+
+	metrics_begin(m, PHASE_SEARCH);
+	if (start_workers(s, workers) == -1) {
+		err = errno;
+		free(workers);
+		close(s->fd);
+		unlink(s->path);
+		word_list_slot_destroy(&s->nouns);
+		errno = err;
+		return -1;
+	}
+	log_info("Serving on %s: workers=%ld", s->path, s->nworkers);
+
+	for (;;) {
+		if (sigwait(&set, &sig) != 0)
+			continue;
+
+		if (sig == SIGHUP)
+			reload(s);
+		else if (sig == SIGUSR1)
+			report(s, workers, m, metrics_file);
+		else
+			break;
+	}
+
+	stop_workers(s, workers, s->nworkers);
+	free(workers);
+	close(s->fd);
+	unlink(s->path);
+	metrics_end(m, PHASE_SEARCH);
+
+	/* no worker is left reading the nouns list */
+	word_list_slot_destroy(&s->nouns);
+
+	log_info("Shut down: served=%lu failed=%lu", atomic_load(&s->served), atomic_load(&s->failed));
+	return 0;
+}
+
+/* loads the nouns list into a new snapshot, along with the words of the
+ * starting palindrome and, if the search is to be pruned, its closure graph */
+static struct word_list_snapshot *
+load(struct server *s)
+{
+	struct word_list_snapshot *snap;
+	struct server_extras *extras;
+	struct word_list nouns;
+	int err;
+
+	ErrorCase(word_list_load_path(&nouns, s->nouns_path) == -1, errno, NULL);
+
+	snap = word_list_freeze(&nouns);
+	err = errno;
+	word_list_destroy(&nouns);
+	ErrorCase(snap == NULL, err, NULL);
+
+	/* the extras are built on the snapshot, which they then go along with */
+	if ((extras = calloc(1, sizeof(struct server_extras))) == NULL)
+		goto fail;
+
+	snap->data = extras;
+	snap->release = release_extras;
+
+	extras->starting = calloc(WORD_LIST_BLOCKS(snap->list.num_words), sizeof(uint64_t));
+	if (extras->starting == NULL)
+		goto fail;
+
+	search_starting_words(&snap->list, extras->starting);
+
+	if (!s->prune)
+		return snap;
+
+	if ((extras->graph = malloc(sizeof(struct state_graph))) == NULL)
+		goto fail;
+
+	if (state_graph_build(extras->graph, &snap->list, STATE_GRAPH_MAXLEN) == -1) {
+		free(extras->graph);
+		extras->graph = NULL;
+		goto fail;
+	}
+
+	log_info("Built state graph: states=%ld dead=%ld", extras->graph->num_nodes, extras->graph->num_dead);
+	return snap;
+
+fail:
+	err = errno;
+	word_list_snapshot_free(snap);
+	errno = err;
+	return NULL;
+}
+
+/* replaces the nouns list with a fresh load of it. The old list is released
+ * by the worker answering the last request still using it, so that signals
+ * are never kept waiting; if the new one cannot be loaded, the old one is
+ * kept. */
+static void
+reload(struct server *s)
+{
+	struct word_list_snapshot *snap;
+
+	if ((snap = load(s)) == NULL) {
+		log_error("Cannot reload %s: %s", s->nouns_path, strerror(errno));
+		return;
+	}
+
+	word_list_slot_swap(&s->nouns, snap);
+
+	log_info("Reloaded %s: words=%ld generation=%lu", s->nouns_path, snap->list.num_words, snap->generation);
+}
+
+static void
+release_extras(void *data)
+{
+	struct server_extras *extras = data;
+
+	if (extras->graph != NULL) {
+		state_graph_destroy(extras->graph);
+		free(extras->graph);
+	}
+
+	free(extras->starting);
+	free(extras);
+}
+
+/* sets up the workers and starts their threads. In case one of them cannot
+ * be started, the ones already running are stopped. */
+static int
+start_workers(struct server *s, struct server_worker *workers)
+{
+	long i;
+	int err;
+
+	for (i = 0; i < s->nworkers; ++i) {
+		workers[i].server = s;
+		workers[i].conn = -1;
+
+		if (s->cache_size > 0 && candidate_cache_init(&workers[i].cache, s->cache_size) == -1) {
+			err = errno;
+			stop_workers(s, workers, i);
+			errno = err;
+			return -1;
+		}
+
+		if ((err = pthread_mutex_init(&workers[i].lock, NULL)) != 0 ||
+				(err = pthread_create(&workers[i].thread, NULL, serve, &workers[i])) != 0) {
+			if (s->cache_size > 0)
+				candidate_cache_destroy(&workers[i].cache);
+			stop_workers(s, workers, i);
+			errno = err;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* stops the first `n` workers, and waits for them. Shutting the listening
+ * socket down wakes up the ones waiting for connections, and shutting down
+ * the connections being answered wakes up the ones waiting for their clients;
+ * searches in progress see `stop` and give up. */
+static void
+stop_workers(struct server *s, struct server_worker *workers, long n)
+{
+	long i;
+
+	atomic_store(&s->stop, true);
+	shutdown(s->fd, SHUT_RDWR);
+
+	for (i = 0; i < n; ++i) {
+		pthread_mutex_lock(&workers[i].lock);
+		if (workers[i].conn != -1)
+			shutdown(workers[i].conn, SHUT_RDWR);
+		pthread_mutex_unlock(&workers[i].lock);
+	}
+
+	for (i = 0; i < n; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		pthread_mutex_destroy(&workers[i].lock);
+		if (s->cache_size > 0)
+			candidate_cache_destroy(&workers[i].cache);
+	}
+}
+
+/* accepts connections until the server is shut down. Clients that stay idle
+ * for longer than SERVER_IDLE_TIMEOUT seconds are dropped, so that they do
+ * not keep the worker from answering others. */
+static void *
+serve(void *arg)
+{
+	struct server_worker *w = arg;
+	struct timeval timeout = { .tv_sec = SERVER_IDLE_TIMEOUT };
+	int fd;
+
+	while (!atomic_load(&w->server->stop)) {
+		fd = accept(w->server->fd, NULL, NULL);
+		if (fd == -1) {
+			if (!atomic_load(&w->server->stop) && errno != EINTR && errno != ECONNABORTED)
+				log_error("accept: %s", strerror(errno));
+			continue;
+		}
+
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1 ||
+				watch(w, fd) == -1) {
+			close(fd);
+			continue;
+		}
+
+		serve_connection(w, fd);
+	}
+
+	return NULL;
+}
+
+/* makes `fd` the connection of the worker, unless the server is being shut
+ * down: the stopping thread checks the connections after setting `stop` */
+static int
+watch(struct server_worker *w, int fd)
+{
+	int retval = 0;
+
+	pthread_mutex_lock(&w->lock);
+	if (atomic_load(&w->server->stop))
+		retval = -1;
+	else
+		w->conn = fd;
+	pthread_mutex_unlock(&w->lock);
+
+	return retval;
+}
+
+/* the worker's connection is about to be closed: its descriptor may be
+ * reused right after */
+static void
+forget(struct server_worker *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->conn = -1;
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* answers every request on the connection `fd`, until the client closes it
+ * or stays idle for too long. The connection is closed afterwards. */
+static void
+serve_connection(struct server_worker *w, int fd)
+{
+	char request[REQUEST_MAXLEN];
+	struct output o;
+	FILE *in;
+
+	if ((in = fdopen(fd, "r")) == NULL) {
+		forget(w);
+		close(fd);
+		return;
+	}
+
+	if (output_init(&o, fd, false) == -1) {
+		forget(w);
+		fclose(in);
+		return;
+	}
+
+	while (fgets(request, sizeof(request), in) != NULL) {
+		if (answer(w, &o, request) == -1 || output_flush(&o) == -1)
+			break;
+	}
+
+	output_destroy(&o);
+	forget(w);
+	fclose(in);
+}
+
+/* runs a new search for the `request`, and writes its response to `o`.
+ * Searches that cannot close a palindrome within SERVER_REQUEST_TIMEOUT
+ * seconds are given up, so that they do not keep the worker from others.
+ * Returns -1 only if the response could not be written. */
+static int
+answer(struct server_worker *w, struct output *o, char *request)
+{
+	struct server *s = w->server;
+	struct word_list_snapshot *snap;
+	struct server_extras *extras;
+	struct search search;
+	struct timespec deadline;
+	unsigned long ticket;
+	unsigned int seed;
+	long size;
+	int status, retval;
+
+	if (parse_request(request, &size, &seed) == -1)
+		return reply_error(o, "invalid request (expected: size <words> [seed <seed>])");
+
+	/* the snapshot is only held while searching: the palindrome has its own
+	 * copy of the words */
+	snap = word_list_slot_enter(&s->nouns, &ticket);
+	extras = snap->data;
+	if (s->cache_size > 0 && snap->generation != w->generation) {
+		candidate_cache_clear(&w->cache);
+		w->generation = snap->generation;
+	}
+
+	if (search_init(&search, &snap->list, extras->graph, s->cache_size > 0 ? &w->cache : NULL, size, seed) == -1) {
+		word_list_slot_exit(&s->nouns, ticket);
+		return reply_error(o, "cannot start a search");
+	}
+
+	if (s->unique && search_unique_from(&search, extras->starting) == -1) {
+		search_destroy(&search);
+		word_list_slot_exit(&s->nouns, ticket);
+		return reply_error(o, "cannot start a search");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += SERVER_REQUEST_TIMEOUT;
+
+	status = search_run_until(&search, &s->stop, &deadline);
+	word_list_slot_exit(&s->nouns, ticket);
+	metrics_sum(&s->total, &search.counters);
+	log_info("Request: size=%ld seed=%u status=%d", size, seed, status);
+
+	if (status == 0) {
+		atomic_fetch_add(&s->served, 1);
+		retval = (output_words(o, &search.palindrome, true, true) == -1 ||
+				output_write(o, "\n", 1) == -1) ? -1 : 0;
+	} else {
+		atomic_fetch_add(&s->failed, 1);
+		retval = reply_error(o, status == 1 ? "server shutting down" :
+				status == 2 ? "search timed out" : "no palindrome found");
+	}
+
+	search_destroy(&search);
+	return retval;
+}
+
+static int
+reply_error(struct output *o, const char *reason)
+{
+	if (output_write(o, "error: ", 7) == -1 ||
+			output_write(o, reason, strlen(reason)) == -1 ||
+			output_write(o, "\n", 1) == -1)
+		return -1;
+
+	return 0;
+}
+
+/* parses "size <words> [seed <seed>]". Commas are taken as blanks. */
+static int
+parse_request(char *request, long *size, unsigned int *seed)
+{
+	char *key, *value, *endptr, *saveptr;
+	const char *delim = " ,\t\r\n";
+
+	*size = 0;
+	*seed = time(NULL);
+
+	for (key = strtok_r(request, delim, &saveptr); key != NULL; key = strtok_r(NULL, delim, &saveptr)) {
+		value = strtok_r(NULL, delim, &saveptr);
+		ErrorCase(value == NULL, EINVAL, -1);
+
+		if (strcmp(key, "size") == 0) {
+			*size = strtol(value, &endptr, 10);
+		} else if (strcmp(key, "seed") == 0) {
+			*seed = strtoul(value, &endptr, 10);
+		} else {
+			errno = EINVAL;
+			return -1;
+		}
+
+		ErrorCase(*endptr != '\0', EINVAL, -1);
+	}
+
+	ErrorCase(*size <= 0 || *size > SERVER_MAX_SIZE, EINVAL, -1);
+	return 0;
+}
+
+/* writes the counters of every search so far, and of the worker caches */
+static void
+report(struct server *s, struct server_worker *workers, struct metrics *m, FILE *f)
+{
+	struct metrics_counters total;
+	long i;
+
+	memset(&total, 0, sizeof(total));
+	metrics_sum(&total, &s->total);
+
+	if (s->cache_size > 0) {
+		for (i = 0; i < s->nworkers; ++i) {
+			atomic_fetch_add(&total.cache_hits, atomic_load(&workers[i].cache.hits));
+			atomic_fetch_add(&total.cache_misses, atomic_load(&workers[i].cache.misses));
+			atomic_fetch_add(&total.cache_evictions, atomic_load(&workers[i].cache.evictions));
+		}
+	}
+
+	log_info("Requests: served=%lu failed=%lu", atomic_load(&s->served), atomic_load(&s->failed));
+	metrics_dump(f, m, &total, s->nworkers);
+}
@@ -0,0 +1,79 @@
+/* server - answers palindrome requests over a Unix domain socket.
+ *
+ * The nouns list (and the closure graph, if any) is loaded once, frozen in a
+ * snapshot (see word_list.h) and shared, read-only, by a fixed number of
+ * worker threads. Each worker accepts
+ * connections on its own and answers the requests on them, one per line,
+ * with a new search for each of them:
+ *
+ * 	request:  size <words> [seed <seed>]
+ * 	response: the palindrome, or "error: <reason>", on a single line
+ *
+ * When no seed is given, the current time is used. Searches taking more than
+ * SERVER_REQUEST_TIMEOUT seconds are given up, and connections idle for more
+ * than SERVER_IDLE_TIMEOUT seconds are closed.
+ *
+ * On SIGHUP, the nouns list is loaded again, and the new snapshot replaces
+ * the old one without stopping the workers: requests being answered finish
+ * with the old list, and the next ones use the new list. A worker keeps its
+ * candidate cache from one request to the next, until the list changes. */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdatomic.h>
+
+#include "word_list.h"
+#include "state_graph.h"
+#include "metrics.h"
+
+/* largest palindrome served */
+#ifndef SERVER_MAX_SIZE
+#  define SERVER_MAX_SIZE (100000)
+#endif
+
+/* seconds a client may go without sending a request (or reading the
+ * response) before its connection is closed */
+#ifndef SERVER_IDLE_TIMEOUT
+#  define SERVER_IDLE_TIMEOUT (30)
+#endif
+
+/* seconds a search may take before the request is answered with an error */
+#ifndef SERVER_REQUEST_TIMEOUT
+#  define SERVER_REQUEST_TIMEOUT (10)
+#endif
+
+struct server {
+	const char *path;       /* of the socket */
+	const char *nouns_path; /* text or compiled nouns list */
+	bool prune;             /* whether to search with the closure graph */
+	long cache_size;        /* entries of each worker cache; 0 disables it */
+	bool unique;            /* whether nouns are used only once */
+	long nworkers;
+
+	struct word_list_slot nouns; /* the current list, and its graph */
+
+	int fd;          /* listening socket */
+	atomic_bool stop; /* set when the server is shutting down */
+
+	/* counters of every search made so far, and of the requests */
+	struct metrics_counters total;
+	atomic_ulong served, failed;
+};
+
+/* loads the nouns list, listens on the socket at `s->path` (replacing any
+ * socket left there) and answers requests with `s->nworkers` threads, until
+ * SIGINT or SIGTERM is received. On SIGHUP, the nouns list is reloaded. On
+ * SIGUSR1, the counters of every search so far are written to
+ * `metrics_file`, along with the phases in `m`. These signals are blocked
+ * in the calling thread, and in the workers it starts, so that they are only
+ * taken by `server_run`: other threads of the caller must block them as
+ * well.
+ *
+ * On shutdown, connections still open are closed and every worker is waited
+ * for before the nouns list is released.
+ *
+ * Returns a positive number once the server is shut down, -1 on error */
+int server_run(struct server *s, struct metrics *m, FILE *metrics_file);
+
+#endif /* SERVER_H */
@@ -0,0 +1,366 @@
+#include "state_graph.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* node keys are the state prefixed by a direction marker, so that the same
+ * letters waiting for a left or a right word are different nodes */
+#define KEY_SIZE (WORD_LIST_LARGEST_NOUN + 4)
+#define DIRECTION_MARKER(dir) ((dir) == LEFT ? '<' : '>')
+
+/* transitions between two nodes, only needed while the graph is built */
+struct edge {
+	long from, to;
+};
+
+struct edges {
+	struct edge *list;
+	long num_edges, size;
+};
+
+static unsigned long hash(const char *key);
+static long find(const struct state_graph *g, const char *key);
+static long intern(struct state_graph *g, const char *key);
+static int grow_slots(struct state_graph *g);
+static void make_key(char *key, enum palindrome_direction dir, const char *state, size_t len, bool reversed);
+static int add_transition(struct state_graph *g, struct edges *e, const char *from, const char *to, size_t tolen);
+static int compute_distances(struct state_graph *g, struct edges *e);
+
+int
+state_graph_build(struct state_graph *g, struct word_list *wl, size_t maxlen)
+{
+	ErrorCase(g == NULL || wl == NULL, EINVAL, -1);
+	ErrorCase(maxlen == 0 || maxlen > STATE_GRAPH_MAXLEN, EINVAL, -1);
+
+	char token[WORD_LIST_LARGEST_NOUN + 3], article[3];
+	char from[KEY_SIZE], to[KEY_SIZE];
+	struct edges e = { NULL, 0, 0 };
+	size_t k, n;
+	long i;
+
+	memset(g, 0, sizeof(struct state_graph));
+	g->maxlen = maxlen;
+	g->num_slots = 1024;
+	g->slots = malloc(g->num_slots * sizeof(long));
+	ErrorCase(g->slots == NULL, errno, -1);
+	memset(g->slots, -1, g->num_slots * sizeof(long));
+
+	for (i = 0; i < wl->num_words; ++i) {
+		word_list_article(WORD_LIST_WORD(wl, i), article);
+		snprintf(token, sizeof(token), "%s%s", article, WORD_LIST_WORD(wl, i));
+		n = strlen(token);
+
+		/* a left word must start with the state; whatever is left of it,
+		 * reversed, is the state for the next (right) word */
+		for (k = 0; k <= n && k <= maxlen; ++k) {
+			make_key(from, LEFT, token, k, false);
+			make_key(to, RIGHT, &(token[k]), n - k, true);
+
+			if (add_transition(g, &e, from, to, n - k) == -1)
+				goto fail;
+		}
+
+		/* a right word must end with the state, and the letters left over
+		 * must end with an 'a', to be matched by the article of the next
+		 * (left) word, unless there are none */
+		for (k = 0; k <= n; ++k) {
+			if (n - k > maxlen || (k > 0 && token[k - 1] != 'a'))
+				continue;
+
+			make_key(from, RIGHT, &(token[k]), n - k, false);
+			make_key(to, LEFT, token, k, true);
+
+			if (add_transition(g, &e, from, to, k) == -1)
+				goto fail;
+		}
+	}
+
+	if (compute_distances(g, &e) == -1)
+		goto fail;
+
+	free(e.list);
+	return 0;
+
+fail:
+	free(e.list);
+	state_graph_destroy(g);
+	return -1;
+}
+
+long
+state_graph_distance(const struct state_graph *g, const char *state, enum palindrome_direction direction)
+{
+	char key[KEY_SIZE];
+	size_t len = strlen(state);
+	long idx;
+
+	if (len > g->maxlen)
+		return STATE_GRAPH_UNKNOWN;
+
+	make_key(key, direction, state, len, false);
+	idx = find(g, key);
+
+	/* states that no word can follow never make it to the graph */
+	if (idx == -1)
+		return state_is_palindrome(state) ? 0 : STATE_GRAPH_DEAD;
+
+	return g->nodes[idx].distance;
+}
+
+bool
+state_is_palindrome(const char *state)
+{
+	size_t len = strlen(state);
+	size_t i, j;
+
+	if (len == 0)
+		return true;
+
+	i = 0; j = len - 1;
+	while (i < j) {
+		if (state[i] != state[j])
+			return false;
+
+		++i; --j;
+	}
+
+	return true;
+}
+
+int
+state_graph_destroy(struct state_graph *g)
+{
+	ErrorCase(g == NULL, EINVAL, -1);
+
+	free(g->slots);
+	free(g->nodes);
+	free(g->keys);
+	memset(g, 0, sizeof(struct state_graph));
+
+	return 0;
+}
+
+/* FNV-1a */
+static unsigned long
+hash(const char *key)
+{
+	unsigned long h = 14695981039346656037UL;
+
+	while (*key) {
+		h ^= (unsigned char) *key++;
+		h *= 1099511628211UL;
+	}
+
+	return h;
+}
+
+static long
+find(const struct state_graph *g, const char *key)
+{
+	unsigned long mask = g->num_slots - 1,
+	              slot = hash(key) & mask;
+
+	while (g->slots[slot] != -1) {
+		if (strcmp(&(g->keys[g->nodes[g->slots[slot]].key]), key) == 0)
+			return g->slots[slot];
+
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+}
+
+/* returns the index of the node with the given key, creating it if needed */
+static long
+intern(struct state_graph *g, const char *key)
+{
+	unsigned long mask, slot;
+	size_t len = strlen(key) + 1;
+	long idx;
+	void *p;
+
+	if ((idx = find(g, key)) != -1)
+		return idx;
+
+	/* keep the hash table at most half full */
+	if (2 * (g->num_nodes + 1) > g->num_slots)
+		ErrorCase(grow_slots(g) == -1, errno, -1);
+
+	if (g->num_nodes % 1024 == 0) {
+		p = realloc(g->nodes, (g->num_nodes + 1024) * sizeof(struct state_node));
+		ErrorCase(p == NULL, errno, -1);
+		g->nodes = p;
+	}
+
+	if (g->keys_len + len > g->keys_size) {
+		g->keys_size = 2 * (g->keys_size + len);
+		p = realloc(g->keys, g->keys_size);
+		ErrorCase(p == NULL, errno, -1);
+		g->keys = p;
+	}
+
+	memcpy(&(g->keys[g->keys_len]), key, len);
+	g->nodes[g->num_nodes].key = g->keys_len;
+	g->nodes[g->num_nodes].distance = STATE_GRAPH_DEAD;
+	g->nodes[g->num_nodes].partial = false;
+	g->keys_len += len;
+
+	mask = g->num_slots - 1;
+	slot = hash(key) & mask;
+	while (g->slots[slot] != -1)
+		slot = (slot + 1) & mask;
+	g->slots[slot] = g->num_nodes;
+
+	return g->num_nodes++;
+}
+
+/* doubles the hash table, reinserting every node */
+static int
+grow_slots(struct state_graph *g)
+{
+	long num_slots = 2 * g->num_slots, *slots, i;
+	unsigned long mask = num_slots - 1, slot;
+
+	slots = malloc(num_slots * sizeof(long));
+	ErrorCase(slots == NULL, errno, -1);
+	memset(slots, -1, num_slots * sizeof(long));
+
+	for (i = 0; i < g->num_nodes; ++i) {
+		slot = hash(&(g->keys[g->nodes[i].key])) & mask;
+		while (slots[slot] != -1)
+			slot = (slot + 1) & mask;
+		slots[slot] = i;
+	}
+
+	free(g->slots);
+	g->slots = slots;
+	g->num_slots = num_slots;
+
+	return 0;
+}
+
+/* writes to `key` the node key for the first `len` letters of `state`,
+ * optionally reversing them */
+static void
+make_key(char *key, enum palindrome_direction dir, const char *state, size_t len, bool reversed)
+{
+	size_t i;
+
+	key[0] = DIRECTION_MARKER(dir);
+	for (i = 0; i < len; ++i)
+		key[i + 1] = reversed ? state[len - i - 1] : state[i];
+	key[len + 1] = '\0';
+}
+
+/* records the transition `from` -> `to`. Transitions into states longer than
+ * the graph `maxlen` are not followed, but leave `from` marked as partial */
+static int
+add_transition(struct state_graph *g, struct edges *e, const char *from, const char *to, size_t tolen)
+{
+	long f, t;
+	void *p;
+
+	ErrorCase((f = intern(g, from)) == -1, errno, -1);
+
+	if (tolen > g->maxlen) {
+		g->nodes[f].partial = true;
+		return 0;
+	}
+
+	ErrorCase((t = intern(g, to)) == -1, errno, -1);
+
+	if (e->num_edges == e->size) {
+		e->size = e->size ? 2 * e->size : 4096;
+		p = realloc(e->list, e->size * sizeof(struct edge));
+		ErrorCase(p == NULL, errno, -1);
+		e->list = p;
+	}
+
+	e->list[e->num_edges].from = f;
+	e->list[e->num_edges].to = t;
+	++e->num_edges;
+
+	return 0;
+}
+
+/* breadth-first search backwards from every palindromic state: the order in
+ * which states are reached is their distance to a palindromic closure. States
+ * that could only be closed through states beyond `maxlen` are unknown. */
+static int
+compute_distances(struct state_graph *g, struct edges *e)
+{
+	long *first, *preds, *queue, head, tail, i, j, u, v;
+
+	first = calloc(g->num_nodes + 1, sizeof(long));
+	preds = malloc((e->num_edges + 1) * sizeof(long));
+	queue = malloc((g->num_nodes + 1) * sizeof(long));
+	if (first == NULL || preds == NULL || queue == NULL) {
+		free(first); free(preds); free(queue);
+		return -1;
+	}
+
+	/* predecessors of each node, stored contiguously */
+	for (i = 0; i < e->num_edges; ++i)
+		++first[e->list[i].to + 1];
+	for (i = 0; i < g->num_nodes; ++i)
+		first[i + 1] += first[i];
+	for (i = 0; i < e->num_edges; ++i)
+		preds[first[e->list[i].to]++] = e->list[i].from;
+	for (i = g->num_nodes; i > 0; --i)
+		first[i] = first[i - 1];
+	first[0] = 0;
+
+	head = tail = 0;
+	for (i = 0; i < g->num_nodes; ++i) {
+		if (state_is_palindrome(&(g->keys[g->nodes[i].key + 1]))) {
+			g->nodes[i].distance = 0;
+			queue[tail++] = i;
+		}
+	}
+
+	while (head < tail) {
+		v = queue[head++];
+		for (j = first[v]; j < first[v + 1]; ++j) {
+			u = preds[j];
+			if (g->nodes[u].distance == STATE_GRAPH_DEAD) {
+				g->nodes[u].distance = g->nodes[v].distance + 1;
+				queue[tail++] = u;
+			}
+		}
+	}
+
+	/* whatever leads to a partial state that was not closed is unknown */
+	head = tail = 0;
+	for (i = 0; i < g->num_nodes; ++i) {
+		if (g->nodes[i].partial && g->nodes[i].distance == STATE_GRAPH_DEAD) {
+			g->nodes[i].distance = STATE_GRAPH_UNKNOWN;
+			queue[tail++] = i;
+		}
+	}
+
+	while (head < tail) {
+		v = queue[head++];
+		for (j = first[v]; j < first[v + 1]; ++j) {
+			u = preds[j];
+			if (g->nodes[u].distance == STATE_GRAPH_DEAD) {
+				g->nodes[u].distance = STATE_GRAPH_UNKNOWN;
+				queue[tail++] = u;
+			}
+		}
+	}
+
+	g->num_dead = 0;
+	for (i = 0; i < g->num_nodes; ++i)
+		if (g->nodes[i].distance == STATE_GRAPH_DEAD)
+			++g->num_dead;
+
+	free(first);
+	free(preds);
+	free(queue);
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/* state_graph - which leftover states can still be closed into a palindrome.
+ *
+ * Whether a given `state` (the letters that do not fit the palindrome yet) can
+ * ever be closed depends only on the dictionary. Every word in the dictionary
+ * takes a state to a new one, following the same rule used by the generator;
+ * this module builds that graph once and computes, for every state, the least
+ * number of words needed to reach a palindromic state (which closes the
+ * palindrome). States that cannot reach any palindromic state are dead ends. */
+
+#ifndef STATE_GRAPH_H
+#define STATE_GRAPH_H
+
+#include "word_list.h"
+
+/* states longer than this are not analysed. Since states are always a piece
+ * of an article and a word, the default covers every possible state. */
+#ifndef STATE_GRAPH_MAXLEN
+#  define STATE_GRAPH_MAXLEN (WORD_LIST_LARGEST_NOUN + 2)
+#endif
+
+/* distances returned for states that cannot be closed, and for states that
+ * were not analysed */
+#define STATE_GRAPH_DEAD    (-1)
+#define STATE_GRAPH_UNKNOWN (-2)
+
+enum palindrome_direction { LEFT, RIGHT };
+
+struct state_node {
+	size_t key;    /* offset of the node key in the keys arena */
+	long distance; /* words needed to reach a palindromic state */
+	bool partial;  /* some of the transitions were beyond `maxlen` */
+};
+
+struct state_graph {
+	size_t maxlen;           /* longest state analysed */
+	long num_nodes;          /* number of states in the graph */
+	long num_dead;           /* number of dead end states */
+	long num_slots;          /* size of the hash table, a power of 2 */
+	long *slots;             /* hash table of node indexes, -1 when empty */
+	struct state_node *nodes;
+	char *keys;              /* direction and state of every node, NUL-terminated */
+	size_t keys_len, keys_size;
+};
+
+/* builds the graph of states reachable through the words in `wl`, for states
+ * up to `maxlen` letters long.
+ *
+ * Returns a positive number on success, -1 on error */
+int state_graph_build(struct state_graph *g, struct word_list *wl, size_t maxlen);
+
+/* returns the number of words needed to take `state` into a palindromic
+ * state, when the next word is to be added in `direction`. Returns
+ * STATE_GRAPH_DEAD if that is not possible, or STATE_GRAPH_UNKNOWN if the
+ * state is longer than the graph `maxlen`. */
+long state_graph_distance(const struct state_graph *g, const char *state, enum palindrome_direction direction);
+
+/* whether the given state closes the palindrome, that is, if it reads the
+ * same backwards */
+bool state_is_palindrome(const char *state);
+
+/* releases the memory used by the graph */
+int state_graph_destroy(struct state_graph *g);
+
+#endif /* STATE_GRAPH_H */
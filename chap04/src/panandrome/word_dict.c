@@ -0,0 +1,230 @@
+#include "word_dict.h"
+
+#define ErrorCase(condition, err, ret_val) { \
+	if (condition) { \
+		errno = err; \
+		return ret_val; \
+	} \
+}
+
+/* every word is encoded as the length of the prefix it shares with the
+ * previous word in its block (zero for the first word of a block), the
+ * number of letters that follow, and those letters */
+#define ENTRY_HEADER (2)
+
+static int reserve(struct word_dict *d, size_t n);
+static size_t decode(const unsigned char *entry, char *word);
+static long bound(const struct word_dict *d, const char *key, size_t n, bool upper);
+static bool before(const char *word, const char *key, size_t n, bool upper);
+
+int
+word_dict_init(struct word_dict *d)
+{
+	ErrorCase(d == NULL, EINVAL, -1);
+
+	d->num_words = 0;
+	d->num_blocks = 0;
+	d->data = NULL;
+	d->len = d->size = 0;
+	d->blocks = NULL;
+	d->last[0] = '\0';
+
+	return 0;
+}
+
+int
+word_dict_append(struct word_dict *d, const char *word)
+{
+	ErrorCase(d == NULL || word == NULL, EINVAL, -1);
+
+	size_t len = strlen(word), shared = 0;
+	void *p;
+
+	ErrorCase(len >= WORD_LIST_LARGEST_NOUN, EINVAL, -1);
+	ErrorCase(d->num_words > 0 && strcmp(d->last, word) > 0, EINVAL, -1);
+
+	if (d->num_words % WORD_DICT_BLOCK == 0) {
+		/* block offsets grow in the same (doubling) steps as the data */
+		if ((d->num_blocks & (d->num_blocks - 1)) == 0) {
+			p = realloc(d->blocks, (d->num_blocks ? 2 * d->num_blocks : 1) * sizeof(size_t));
+			ErrorCase(p == NULL, errno, -1);
+			d->blocks = p;
+		}
+
+		d->blocks[d->num_blocks++] = d->len;
+	} else {
+		while (word[shared] != '\0' && word[shared] == d->last[shared])
+			++shared;
+	}
+
+	ErrorCase(reserve(d, ENTRY_HEADER + len - shared) == -1, errno, -1);
+
+	d->data[d->len++] = shared;
+	d->data[d->len++] = len - shared;
+	memcpy(&(d->data[d->len]), &(word[shared]), len - shared);
+	d->len += len - shared;
+
+	memcpy(d->last, word, len + 1);
+	++d->num_words;
+
+	return 0;
+}
+
+int
+word_dict_load(struct word_dict *d, FILE *stream)
+{
+	ErrorCase(d == NULL, EINVAL, -1);
+	ErrorCase(stream == NULL, errno, -1);
+
+	char word[WORD_LIST_LARGEST_NOUN];
+	size_t len;
+
+	while (fgets(word, WORD_LIST_LARGEST_NOUN, stream) != NULL) {
+		len = strlen(word);
+		if (len > 0 && word[len - 1] == '\n')
+			word[len - 1] = '\0';
+
+		ErrorCase(word_dict_append(d, word) == -1, errno, -1);
+	}
+
+	return 0;
+}
+
+int
+word_dict_get(const struct word_dict *d, long id, char *buffer)
+{
+	ErrorCase(d == NULL || buffer == NULL, EINVAL, -1);
+	ErrorCase(id < 0 || id >= d->num_words, EINVAL, -1);
+
+	const unsigned char *entry = &(d->data[d->blocks[id / WORD_DICT_BLOCK]]);
+	long i;
+
+	for (i = 0; i <= id % WORD_DICT_BLOCK; ++i)
+		entry += decode(entry, buffer);
+
+	return 0;
+}
+
+int
+word_dict_exact(const struct word_dict *d, const char *word, struct word_list_span *span)
+{
+	ErrorCase(d == NULL || word == NULL || span == NULL, EINVAL, -1);
+
+	span->order = NULL;
+	span->first = bound(d, word, SIZE_MAX, false);
+	span->count = bound(d, word, SIZE_MAX, true) - span->first;
+
+	return 0;
+}
+
+int
+word_dict_prefix(const struct word_dict *d, const char *prefix, struct word_list_span *span)
+{
+	ErrorCase(d == NULL || prefix == NULL || span == NULL, EINVAL, -1);
+
+	span->order = NULL;
+	span->first = bound(d, prefix, strlen(prefix), false);
+	span->count = bound(d, prefix, strlen(prefix), true) - span->first;
+
+	return 0;
+}
+
+size_t
+word_dict_memory(const struct word_dict *d)
+{
+	return sizeof(struct word_dict) + d->size + d->num_blocks * sizeof(size_t);
+}
+
+int
+word_dict_destroy(struct word_dict *d)
+{
+	ErrorCase(d == NULL, EINVAL, -1);
+
+	free(d->data);
+	free(d->blocks);
+
+	return word_dict_init(d);
+}
+
+/* makes room for `n` more bytes of data */
+static int
+reserve(struct word_dict *d, size_t n)
+{
+	size_t size = d->size ? d->size : 4096;
+	void *p;
+
+	if (d->len + n <= d->size)
+		return 0;
+
+	while (d->len + n > size)
+		size *= 2;
+
+	p = realloc(d->data, size);
+	ErrorCase(p == NULL, errno, -1);
+
+	d->data = p;
+	d->size = size;
+
+	return 0;
+}
+
+/* applies the entry to `word`, which holds the previous word in the block.
+ * Returns the size of the entry. */
+static size_t
+decode(const unsigned char *entry, char *word)
+{
+	size_t shared = entry[0], len = entry[1];
+
+	memcpy(&(word[shared]), &(entry[ENTRY_HEADER]), len);
+	word[shared + len] = '\0';
+
+	return ENTRY_HEADER + len;
+}
+
+/* whether `word` comes before the words that match `key` (on their first
+ * `n` letters) or, if `upper`, before the words that come after them */
+static bool
+before(const char *word, const char *key, size_t n, bool upper)
+{
+	int c = strncmp(word, key, n);
+
+	return c < 0 || (upper && c == 0);
+}
+
+/* position of the first word for which `before` does not hold. The first
+ * words of the blocks narrow the search down to a single block, which is then
+ * decoded. */
+static long
+bound(const struct word_dict *d, const char *key, size_t n, bool upper)
+{
+	char word[WORD_LIST_LARGEST_NOUN];
+	const unsigned char *entry;
+	long lo = 0, hi = d->num_blocks, mid, id;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		decode(&(d->data[d->blocks[mid]]), word);
+
+		if (before(word, key, n, upper))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* every word of the blocks before `lo` comes before the key, as does
+	 * the first word of block `lo - 1` */
+	if (lo == 0)
+		return 0;
+
+	id = (lo - 1) * WORD_DICT_BLOCK;
+	entry = &(d->data[d->blocks[lo - 1]]);
+	entry += decode(entry, word);
+
+	for (++id; id < d->num_words && id < lo * WORD_DICT_BLOCK; ++id) {
+		entry += decode(entry, word);
+		if (!before(word, key, n, upper))
+			break;
+	}
+
+	return id;
+}
@@ -0,0 +1,74 @@
+/* word_dict - a compressed, read-only, sorted dictionary.
+ *
+ * Every word in a `word_list` takes a slot of WORD_LIST_LARGEST_NOUN bytes,
+ * which is a lot for lists of millions of (mostly short) words. Since nouns
+ * lists are sorted, consecutive words share long prefixes, and this module
+ * stores them front coded: words are grouped in blocks of WORD_DICT_BLOCK,
+ * the first word of each block is kept whole and every other word is kept
+ * as the length of the prefix it shares with the previous word followed by
+ * the remaining letters.
+ *
+ * The first words of the blocks are used to binary search the dictionary,
+ * and a word is found by decoding at most a single block. */
+
+#ifndef WORD_DICT_H
+#define WORD_DICT_H
+
+#include "word_list.h"
+
+/* words per block: larger blocks compress better, but make random access
+ * slower */
+#ifndef WORD_DICT_BLOCK
+#  define WORD_DICT_BLOCK (32)
+#endif
+
+struct word_dict {
+	long num_words;
+	long num_blocks;
+
+	unsigned char *data; /* the encoded blocks, one after the other */
+	size_t len, size;    /* bytes used and allocated in `data` */
+	size_t *blocks;      /* offset of each block in `data` */
+
+	char last[WORD_LIST_LARGEST_NOUN]; /* last word added, while loading */
+};
+
+/* initializes an empty dictionary.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_dict_init(struct word_dict *d);
+
+/* adds `word` to the end of the dictionary. Words must be added in
+ * alphabetical (`strcmp(3)`) order.
+ *
+ * Returns a positive number on success, or -1 on error, with errno set to
+ * EINVAL if the word is too long or out of order. */
+int word_dict_append(struct word_dict *d, const char *word);
+
+/* loads a nouns list, with one word per line, alphabetically sorted. Unlike
+ * `word_list_load`, the whole list is never kept uncompressed in memory.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_dict_load(struct word_dict *d, FILE *stream);
+
+/* copies the word at position `id` to `buffer`, which must be at least
+ * WORD_LIST_LARGEST_NOUN bytes long.
+ *
+ * Returns a positive number on success, or -1 with errno set to EINVAL if
+ * there is no such word. */
+int word_dict_get(const struct word_dict *d, long id, char *buffer);
+
+/* find the words equal to `word`, or starting with `prefix`. Matching words
+ * are always consecutive, so the `span` has no `order`.
+ *
+ * Return a positive number on success, -1 on error */
+int word_dict_exact(const struct word_dict *d, const char *word, struct word_list_span *span);
+int word_dict_prefix(const struct word_dict *d, const char *prefix, struct word_list_span *span);
+
+/* number of bytes taken by the dictionary */
+size_t word_dict_memory(const struct word_dict *d);
+
+/* releases the memory used by the dictionary */
+int word_dict_destroy(struct word_dict *d);
+
+#endif /* WORD_DICT_H */
@@ -1,4 +1,11 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "word_list.h"
+#include "log.h"
 
 #define ErrorCase(condition, err, ret_val) { \
 	if (condition) { \
@@ -7,30 +14,201 @@
 	} \
 }
 
+#define CACHE_ALIGN(n) (((n) + WORD_LIST_CACHE_LINE - 1) & ~((size_t) WORD_LIST_CACHE_LINE - 1))
+
+/* header of a compiled dictionary. Sections are at the given offsets from
+ * the beginning of the file; `by_word` is zero when the list is sorted. */
+struct dictionary_header {
+	char magic[sizeof(WORD_LIST_MAGIC)];
+	uint32_t version;
+	int64_t num_words;
+	uint64_t by_word, by_suffix, offsets, signatures, articles, strings;
+	uint64_t size; /* of the whole file */
+};
+
+/* an entry of the suffix index, while it is sorted */
+struct keyed_id {
+	const char *word;
+	long id;
+};
+
+/* the preprocessing pipeline (see `word_list_prepare`) spreads words over
+ * buckets by their first two letters (or by their last two, for the suffix
+ * index). Buckets are in alphabetical order, so they can be sorted on their
+ * own, by any thread, and then be laid out one after the other. */
+#define PREP_BUCKETS    (26 * 27)
+#define PREP_MAXTHREADS (256)
+
+/* a word (or reversed word) being sorted. Words are sorted by their first 8
+ * letters, packed in an integer, and only compared as strings when those are
+ * the same: sorting then seldom has to reach the strings themselves. */
+struct prep_word {
+	uint64_t prefix;
+	const char *word;
+	uint32_t len;
+	uint32_t id; /* in the list, once laid out */
+};
+
+/* what each thread of the pipeline owns */
+struct prep_thread {
+	pthread_t thread;
+	long id;
+	struct prep *prep;
+
+	/* its chunk of the input, and the words accepted from it */
+	const char *begin, *end;
+	struct prep_word *words;
+	long num_words;
+
+	/* room to sort a bucket in */
+	struct prep_word *scratch;
+	long scratch_len;
+
+	long counts[PREP_BUCKETS];  /* words it has for each bucket */
+	long cursors[PREP_BUCKETS]; /* where the next of them goes */
+
+	long lines, rejected, duplicates;
+	bool sorted;
+};
+
+/* state shared by the threads of the pipeline. Serial steps, between stages,
+ * are taken by a single thread. */
+struct prep {
+	long nthreads;
+	struct prep_thread *threads;
+	pthread_mutex_t gate; /* held until every thread has its chunk */
+	pthread_barrier_t barrier;
+	atomic_int err;   /* of the first stage to fail */
+	atomic_long next; /* next bucket to be taken */
+
+	/* the normalized words, where their lines are in the input, followed
+	 * by the reversed words, `mirror` bytes later */
+	const char *input;
+	char *text;
+	size_t mirror;
+
+	struct prep_word *words;    /* in buckets, by their first letters */
+	struct prep_word *suffixes; /* reversed words, in buckets by their first letters */
+	long start[PREP_BUCKETS + 1];        /* of each bucket of `words` */
+	long suffix_start[PREP_BUCKETS + 1]; /* of each bucket of `suffixes` */
+	long unique[PREP_BUCKETS];  /* words left in each bucket once deduplicated */
+	size_t bytes[PREP_BUCKETS]; /* taken by them in the strings section */
+	long first_id[PREP_BUCKETS];
+	size_t first_byte[PREP_BUCKETS];
+	long owner[PREP_BUCKETS];   /* thread that laid the bucket out */
+
+	/* the packed list */
+	char *base;
+	size_t len;
+	long *by_suffix;
+	uint32_t *offsets;
+	uint32_t *signatures;
+	uint8_t *articles;
+	char *strings;
+};
+
+static void index_drop(struct word_list *wl);
+static void article_at(const struct word_list *wl, long i, char *buf);
+static const char *chunk_boundary(const char *input, size_t len, long i, long nthreads);
+static void *prepare(void *arg);
+static bool prep_sync(struct prep *p, int (*serial)(struct prep *p));
+static long prep_bucket(uint64_t prefix);
+static uint64_t prep_prefix(const char *word);
+static void prep_normalize(struct prep_thread *t);
+static int prep_place(struct prep *p);
+static void prep_scatter(struct prep_thread *t);
+static void prep_sort(struct prep_thread *t);
+static int prep_layout(struct prep *p);
+static void prep_fill(struct prep_thread *t);
+static int prep_place_suffixes(struct prep *p);
+static void prep_scatter_suffixes(struct prep_thread *t);
+static void prep_sort_suffixes(struct prep_thread *t);
+static int prep_sort_bucket(struct prep_thread *t, struct prep_word *words, long n);
+static int compare_prep_words(const void *a, const void *b);
+static void *pack(struct word_list *wl, size_t *len);
+static void attach(struct word_list *wl, void *base);
+static bool dictionary_valid(const struct dictionary_header *h, size_t len);
+static bool section_fits(uint64_t offset, int64_t count, size_t size, size_t len);
+static void reclaim(struct word_list_slot *slot, int parity);
+static int rcompare(const char *a, const char *b, size_t n);
+static int compare_keyed(const void *a, const void *b);
+static int compare_keyed_reversed(const void *a, const void *b);
+static long *sorted_ids(const struct word_list *wl, int (*compare)(const void *a, const void *b));
+static long bound(const struct word_list *wl, const long *order, const char *key, size_t n, bool upper, bool reversed);
+static void span_of(const struct word_list *wl, const long *order, const char *key, size_t n, bool reversed,
+		struct word_list_span *span);
+
 int
 word_list_init(struct word_list *wl, long size)
+{
+	return word_list_init_with(wl, size, NULL);
+}
+
+int
+word_list_init_with(struct word_list *wl, long size, struct allocator *alloc)
 {
 	ErrorCase(wl == NULL, EINVAL, -1);
 	ErrorCase(size <= 0, EINVAL, -1);
 
+	wl->alloc = alloc;
 	wl->size = size;
 	wl->num_words = 0;
+	wl->dropped = 0;
+	wl->indexed = false;
+	wl->by_word = NULL;
+	wl->by_suffix = NULL;
+	wl->map = NULL;
+	wl->map_len = 0;
+	wl->strings = NULL;
+	wl->offsets = NULL;
+	wl->signatures = NULL;
+	wl->articles = NULL;
 
-	wl->words = malloc(size * sizeof(char *));
+	wl->words = allocator_alloc(alloc, size * sizeof(char *));
 	ErrorCase(wl->words == NULL, errno, -1);
 
 	return 0;
 }
 
+int
+word_list_resize(struct word_list *wl, long size)
+{
+	ErrorCase(wl == NULL, EINVAL, -1);
+	ErrorCase(wl->words == NULL, EPERM, -1);
+	ErrorCase(size <= 0 || size < wl->num_words, EINVAL, -1);
+
+	char **words = allocator_alloc(wl->alloc, size * sizeof(char *));
+	ErrorCase(words == NULL, errno, -1);
+
+	/* the slots of words dropped from the front are reclaimed as well */
+	memcpy(words, wl->words, wl->num_words * sizeof(char *));
+	allocator_release(wl->alloc, wl->words - wl->dropped, wl->size * sizeof(char *));
+
+	wl->words = words;
+	wl->dropped = 0;
+	wl->size = size;
+
+	return 0;
+}
+
 int word_list_remove_at(struct word_list *wl, long p)
 {
-	ErrorCase(p <= 0 || p >= wl->num_words, EINVAL, -1);
+	ErrorCase(p < 0 || p >= wl->num_words, EINVAL, -1);
+	ErrorCase(wl->words == NULL, EPERM, -1);
+	index_drop(wl);
 
-	long i;
-	for (i = p; i < wl->num_words - 1; ++i)
-		strncpy(wl->words[i], wl->words[i + 1], WORD_LIST_LARGEST_NOUN);
+	allocator_release(wl->alloc, wl->words[p], WORD_LIST_LARGEST_NOUN);
+
+	/* the first word is dropped by moving past its slot, which is only
+	 * reclaimed once the list runs out of room (see `word_list_add_at`):
+	 * lists consumed from the front take no shifting */
+	if (p == 0) {
+		++wl->words;
+		++wl->dropped;
+	} else {
+		memmove(&(wl->words[p]), &(wl->words[p + 1]), (wl->num_words - p - 1) * sizeof(char *));
+	}
 
-	free(wl->words[wl->num_words - 1]);
 	--wl->num_words;
 
 	return 0;
@@ -45,17 +223,27 @@ word_list_append(struct word_list *wl, const char *word)
 int
 word_list_add_at(struct word_list *wl, const char *word, long p)
 {
+	ErrorCase(wl->words == NULL, EPERM, -1);
+	ErrorCase(p < 0 || p > wl->num_words, EINVAL, -1);
 	ErrorCase(wl->num_words >= wl->size, ENOMEM, -1);
-	wl->words[wl->num_words] = malloc(WORD_LIST_LARGEST_NOUN);
-	ErrorCase(wl->words[wl->num_words] == NULL, errno, -1);
-
-	long i;
-	for (i = wl->num_words - 1; i >= p; --i)
-		strncpy(wl->words[i + 1], wl->words[i], WORD_LIST_LARGEST_NOUN);
 
 	int len = strlen(word) + 1;
 	ErrorCase(len >= WORD_LIST_LARGEST_NOUN, EINVAL, -1);
 
+	char *w = allocator_alloc(wl->alloc, WORD_LIST_LARGEST_NOUN);
+	ErrorCase(w == NULL, errno, -1);
+	index_drop(wl);
+
+	/* reclaims the slots of the words dropped from the front */
+	if (wl->dropped + wl->num_words >= wl->size) {
+		memmove(wl->words - wl->dropped, wl->words, wl->num_words * sizeof(char *));
+		wl->words -= wl->dropped;
+		wl->dropped = 0;
+	}
+
+	memmove(&(wl->words[p + 1]), &(wl->words[p]), (wl->num_words - p) * sizeof(char *));
+	wl->words[p] = w;
+
 	/* do not copy \n if present (i.e., when data comes from a data file
 	 * read with `fgets(3)` */
 	if (word[len - 2] == '\n') {
@@ -76,21 +264,514 @@ word_list_load(struct word_list *wl, FILE *stream)
 	ErrorCase(wl == NULL, EINVAL, -1);
 	ErrorCase(stream == NULL, errno, -1);
 
-	char *word = malloc(WORD_LIST_LARGEST_NOUN);
+	char word[WORD_LIST_LARGEST_NOUN];
 
 	while (fgets(word, WORD_LIST_LARGEST_NOUN, stream) != NULL) {
 		ErrorCase(word_list_append(wl, word) == -1, errno, -1);
 	}
 
-	free(word);
 	return 0;
 }
 
+int
+word_list_index(struct word_list *wl)
+{
+	ErrorCase(wl == NULL, EINVAL, -1);
+
+	long i;
+
+	/* packed lists are always indexed */
+	if (wl->words == NULL)
+		return 0;
+
+	index_drop(wl);
+
+	/* nouns lists are supposed to be sorted already, in which case word
+	 * positions are their alphabetical order as well */
+	for (i = 1; i < wl->num_words; ++i)
+		if (strcmp(wl->words[i - 1], wl->words[i]) > 0)
+			break;
+
+	if (i < wl->num_words) {
+		wl->by_word = sorted_ids(wl, compare_keyed);
+		ErrorCase(wl->by_word == NULL, errno, -1);
+	}
+
+	wl->by_suffix = sorted_ids(wl, compare_keyed_reversed);
+	if (wl->by_suffix == NULL) {
+		index_drop(wl);
+		return -1;
+	}
+
+	wl->indexed = true;
+	return 0;
+}
+
+int
+word_list_exact(const struct word_list *wl, const char *word, struct word_list_span *span)
+{
+	ErrorCase(wl == NULL || word == NULL || span == NULL || !wl->indexed, EINVAL, -1);
+
+	span_of(wl, wl->by_word, word, SIZE_MAX, false, span);
+	return 0;
+}
+
+int
+word_list_prefix(const struct word_list *wl, const char *prefix, struct word_list_span *span)
+{
+	ErrorCase(wl == NULL || prefix == NULL || span == NULL || !wl->indexed, EINVAL, -1);
+
+	span_of(wl, wl->by_word, prefix, strlen(prefix), false, span);
+	return 0;
+}
+
+int
+word_list_suffix(const struct word_list *wl, const char *suffix, struct word_list_span *span)
+{
+	ErrorCase(wl == NULL || suffix == NULL || span == NULL || !wl->indexed, EINVAL, -1);
+
+	span_of(wl, wl->by_suffix, suffix, strlen(suffix), true, span);
+	return 0;
+}
+
+long
+word_list_span_next(const struct word_list_span *span, const uint64_t *skip, long *cursor)
+{
+	long id;
+
+	while (*cursor < span->count) {
+		id = WORD_LIST_SPAN_ID(span, *cursor);
+
+		if (skip != NULL && span->order == NULL && skip[id / 64] == UINT64_MAX) {
+			*cursor += 64 - id % 64;
+			continue;
+		}
+
+		++*cursor;
+		if (skip == NULL || !WORD_LIST_BIT_TEST(skip, id))
+			return id;
+	}
+
+	return -1;
+}
+
+int
+word_list_save(struct word_list *wl, const char *path)
+{
+	ErrorCase(wl == NULL || path == NULL, EINVAL, -1);
+
+	char tmp[PATH_MAX];
+	void *base;
+	size_t len;
+	FILE *f;
+
+	base = pack(wl, &len);
+	ErrorCase(base == NULL, errno, -1);
+
+	snprintf(tmp, PATH_MAX, "%s.tmp", path);
+	if ((f = fopen(tmp, "w")) == NULL) {
+		free(base);
+		return -1;
+	}
+
+	fwrite(base, 1, len, f);
+	free(base);
+
+	/* the new dictionary only replaces the old one once it is complete */
+	if (fflush(f) == EOF || ferror(f) || fsync(fileno(f)) == -1) {
+		fclose(f);
+		unlink(tmp);
+		return -1;
+	}
+
+	ErrorCase(fclose(f) == EOF, errno, -1);
+	ErrorCase(rename(tmp, path) == -1, errno, -1);
+
+	return 0;
+}
+
+int
+word_list_open(struct word_list *wl, const char *path)
+{
+	ErrorCase(wl == NULL || path == NULL, EINVAL, -1);
+
+	const struct dictionary_header *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	/* indexes are handed out as arrays of `long` */
+	ErrorCase(sizeof(long) != sizeof(int64_t), EINVAL, -1);
+
+	fd = open(path, O_RDONLY);
+	ErrorCase(fd == -1, errno, -1);
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	if ((size_t) st.st_size < sizeof(WORD_LIST_MAGIC)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	ErrorCase(map == MAP_FAILED, errno, -1);
+
+	h = map;
+	if (memcmp(h->magic, WORD_LIST_MAGIC, sizeof(WORD_LIST_MAGIC)) != 0) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* from here on, the file is meant to be a compiled dictionary: it is
+	 * not to be taken for anything else if it cannot be used */
+	if (!dictionary_valid(h, st.st_size)) {
+		if ((size_t) st.st_size >= sizeof(struct dictionary_header) && h->version != WORD_LIST_VERSION)
+			log_error("%s: unsupported compiled dictionary version %u (expected %u)", path, h->version,
+					WORD_LIST_VERSION);
+		else
+			log_error("%s: truncated or corrupt compiled dictionary", path);
+		munmap(map, st.st_size);
+		errno = EBADMSG;
+		return -1;
+	}
+
+	attach(wl, map);
+	wl->map = map;
+	wl->map_len = st.st_size;
+
+	return 0;
+}
+
+int
+word_list_load_path(struct word_list *wl, const char *path)
+{
+	ErrorCase(wl == NULL || path == NULL, EINVAL, -1);
+
+	struct word_list_prep stats;
+
+	if (word_list_open(wl, path) == 0)
+		return 0;
+
+	ErrorCase(errno != EINVAL, errno, -1);
+	ErrorCase(word_list_prepare(wl, path, 0, &stats) == -1, errno, -1);
+
+	log_info("Prepared nouns list: lines=%ld words=%ld rejected=%ld duplicates=%ld sorted=%s",
+			stats.lines, wl->num_words, stats.rejected, stats.duplicates, stats.sorted ? "yes" : "no");
+
+	return 0;
+}
+
+int
+word_list_prepare(struct word_list *wl, const char *path, long nthreads, struct word_list_prep *stats)
+{
+	ErrorCase(wl == NULL || path == NULL || stats == NULL, EINVAL, -1);
+
+	struct prep *p;
+	struct stat st;
+	const char *input = "";
+	size_t len = 0;
+	long i;
+	int fd, err = 0;
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (nthreads > PREP_MAXTHREADS)
+		nthreads = PREP_MAXTHREADS;
+
+	/* the input is only read, straight from the page cache */
+	fd = open(path, O_RDONLY);
+	ErrorCase(fd == -1, errno, -1);
+
+	if (fstat(fd, &st) == -1) {
+		err = errno;
+	} else if ((len = st.st_size) > 0 &&
+			(input = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		err = errno;
+		len = 0;
+	}
+
+	close(fd);
+	ErrorCase(err != 0, err, -1);
+
+	if ((p = calloc(1, sizeof(struct prep))) == NULL ||
+			(p->threads = calloc(nthreads, sizeof(struct prep_thread))) == NULL) {
+		err = errno;
+		free(p);
+		if (len > 0)
+			munmap((void *) input, len);
+		errno = err;
+		return -1;
+	}
+
+	/* words are never longer than their lines */
+	if ((p->text = malloc(2 * (len + 1))) == NULL) {
+		err = errno;
+		free(p->threads);
+		free(p);
+		if (len > 0)
+			munmap((void *) input, len);
+		errno = err;
+		return -1;
+	}
+
+	p->input = input;
+	p->mirror = len + 1;
+	atomic_init(&p->err, 0);
+	atomic_init(&p->next, 0);
+	pthread_mutex_init(&p->gate, NULL);
+
+	/* threads wait for their chunks to be assigned, which depends on how
+	 * many of them could be created: the pipeline goes on with fewer
+	 * threads if some are not */
+	for (i = 0; i < nthreads; ++i)
+		p->threads[i].prep = p;
+
+	pthread_mutex_lock(&p->gate);
+	for (i = 1; i < nthreads; ++i) {
+		if (pthread_create(&(p->threads[i].thread), NULL, prepare, &(p->threads[i])) != 0)
+			break;
+	}
+
+	p->nthreads = nthreads = i;
+	if ((err = pthread_barrier_init(&p->barrier, NULL, nthreads)) != 0)
+		atomic_store(&p->err, err);
+
+	/* chunks end at line boundaries */
+	for (i = 0; i < nthreads; ++i) {
+		p->threads[i].id = i;
+		p->threads[i].begin = chunk_boundary(input, len, i, nthreads);
+		p->threads[i].end = chunk_boundary(input, len, i + 1, nthreads);
+	}
+	pthread_mutex_unlock(&p->gate);
+
+	prepare(&(p->threads[0]));
+	for (i = 1; i < nthreads; ++i)
+		pthread_join(p->threads[i].thread, NULL);
+
+	if (len > 0)
+		munmap((void *) input, len);
+
+	memset(stats, 0, sizeof(struct word_list_prep));
+	stats->sorted = true;
+	for (i = 0; i < nthreads; ++i) {
+		stats->lines += p->threads[i].lines;
+		stats->rejected += p->threads[i].rejected;
+		stats->duplicates += p->threads[i].duplicates;
+		stats->sorted &= p->threads[i].sorted;
+
+		free(p->threads[i].words);
+		free(p->threads[i].scratch);
+	}
+
+	free(p->text);
+	free(p->words);
+	free(p->suffixes);
+	free(p->threads);
+	pthread_mutex_destroy(&p->gate);
+	if (err == 0)
+		pthread_barrier_destroy(&p->barrier);
+
+	if ((err = atomic_load(&p->err)) != 0) {
+		if (p->base != NULL)
+			munmap(p->base, p->len);
+		free(p);
+		errno = err;
+		return -1;
+	}
+
+	attach(wl, p->base);
+	wl->map = p->base;
+	wl->map_len = p->len;
+
+	free(p);
+	return 0;
+}
+
+struct word_list_snapshot *
+word_list_freeze(struct word_list *wl)
+{
+	ErrorCase(wl == NULL, EINVAL, NULL);
+
+	struct word_list_snapshot *snap;
+	size_t len;
+
+	snap = aligned_alloc(WORD_LIST_CACHE_LINE, CACHE_ALIGN(sizeof(struct word_list_snapshot)));
+	ErrorCase(snap == NULL, errno, NULL);
+
+	if ((snap->arena = pack(wl, &len)) == NULL) {
+		free(snap);
+		return NULL;
+	}
+
+	attach(&snap->list, snap->arena);
+	snap->generation = 0;
+	snap->next = NULL;
+	snap->data = NULL;
+	snap->release = NULL;
+
+	return snap;
+}
+
+void
+word_list_snapshot_free(struct word_list_snapshot *snap)
+{
+	if (snap == NULL)
+		return;
+
+	if (snap->release != NULL)
+		snap->release(snap->data);
+
+	free(snap->arena);
+	free(snap);
+}
+
+int
+word_list_slot_init(struct word_list_slot *slot, struct word_list_snapshot *snap)
+{
+	ErrorCase(slot == NULL || snap == NULL, EINVAL, -1);
+
+	int s;
+
+	snap->generation = 0;
+	atomic_init(&slot->published[0], snap);
+	atomic_init(&slot->published[1], NULL);
+	atomic_init(&slot->generation, 0);
+	atomic_init(&slot->readers[0].n, 0);
+	atomic_init(&slot->readers[1].n, 0);
+	atomic_init(&slot->retired[0], NULL);
+	atomic_init(&slot->retired[1], NULL);
+
+	if ((s = pthread_mutex_init(&slot->lock, NULL)) != 0) {
+		errno = s;
+		return -1;
+	}
+
+	return 0;
+}
+
+struct word_list_snapshot *
+word_list_slot_enter(struct word_list_slot *slot, unsigned long *ticket)
+{
+	unsigned long g;
+
+	/* a reader only counts for a generation if the generation did not
+	 * end while it was announcing itself. The snapshot it then reads is
+	 * the one of that generation or, if swaps went on meanwhile, of a later
+	 * one of the same parity: either way, it is retired on this counter. */
+	for (;;) {
+		g = atomic_load(&slot->generation);
+		atomic_fetch_add(&slot->readers[g & 1].n, 1);
+		if (atomic_load(&slot->generation) == g)
+			break;
+
+		atomic_fetch_sub(&slot->readers[g & 1].n, 1);
+	}
+
+	*ticket = g;
+	return atomic_load(&slot->published[g & 1]);
+}
+
+void
+word_list_slot_exit(struct word_list_slot *slot, unsigned long ticket)
+{
+	int parity = ticket & 1;
+
+	if (atomic_fetch_sub(&slot->readers[parity].n, 1) == 1 && atomic_load(&slot->retired[parity]) != NULL)
+		reclaim(slot, parity);
+}
+
+int
+word_list_slot_swap(struct word_list_slot *slot, struct word_list_snapshot *snap)
+{
+	ErrorCase(slot == NULL || snap == NULL, EINVAL, -1);
+
+	struct word_list_snapshot *old;
+	unsigned long g;
+
+	pthread_mutex_lock(&slot->lock);
+
+	g = atomic_load(&slot->generation);
+	snap->generation = g + 1;
+	atomic_store(&slot->published[(g + 1) & 1], snap);
+	atomic_store(&slot->generation, g + 1);
+
+	/* readers that may still be using the old snapshot all announced
+	 * themselves on the counter of generation `g` */
+	old = atomic_load(&slot->published[g & 1]);
+	old->next = atomic_load(&slot->retired[g & 1]);
+	atomic_store(&slot->retired[g & 1], old);
+
+	pthread_mutex_unlock(&slot->lock);
+
+	/* in case they all left already */
+	reclaim(slot, g & 1);
+	return 0;
+}
+
+int
+word_list_slot_destroy(struct word_list_slot *slot)
+{
+	ErrorCase(slot == NULL, EINVAL, -1);
+
+	unsigned long g = atomic_load(&slot->generation);
+
+	word_list_snapshot_free(atomic_load(&slot->published[g & 1]));
+	atomic_store(&slot->published[0], NULL);
+	atomic_store(&slot->published[1], NULL);
+	reclaim(slot, 0);
+	reclaim(slot, 1);
+	pthread_mutex_destroy(&slot->lock);
+
+	return 0;
+}
+
+/* releases the snapshots retired on the counter of the given `parity`, in
+ * case no reader is left on it. Snapshots are only retired with the lock
+ * held, so none of the ones taken can have been retired after the counter
+ * was seen empty. */
+static void
+reclaim(struct word_list_slot *slot, int parity)
+{
+	struct word_list_snapshot *snap = NULL, *next;
+
+	pthread_mutex_lock(&slot->lock);
+	if (atomic_load(&slot->readers[parity].n) == 0)
+		snap = atomic_exchange(&slot->retired[parity], NULL);
+	pthread_mutex_unlock(&slot->lock);
+
+	for (; snap != NULL; snap = next) {
+		next = snap->next;
+		word_list_snapshot_free(snap);
+	}
+}
+
+/* letters other than 'a' to 'z' (there are none in prepared lists) are
+ * left out of the signature */
+uint32_t
+word_list_signature(const char *word)
+{
+	uint32_t signature = 0;
+
+	for (; *word != '\0'; ++word)
+		if (*word >= 'a' && *word <= 'z')
+			signature |= WORD_LIST_LETTER(*word);
+
+	return signature;
+}
+
 /* Decides which article should precede a given word. No complex English rules are
  * embedded in here: the algorithm simply checks whether the first letter of the
  * given word is a vowel or not. */
-static void
-infer_article(const char *word, char *buf)
+void
+word_list_article(const char *word, char *buf)
 {
 	switch (tolower(word[0])) {
 		case 'a':
@@ -115,9 +796,9 @@ word_list_traverse(struct word_list *wl, int (*fn)(const char *word, char *artic
 	char article[3];
 
 	for (i = 0; i < wl->num_words; ++i) {
-		infer_article(wl->words[i], article);
+		article_at(wl, i, article);
 
-		retval = fn(wl->words[i], article, i, wl->num_words);
+		retval = fn(WORD_LIST_WORD(wl, i), article, i, wl->num_words);
 		if (retval != 0)
 			return retval;
 	}
@@ -125,21 +806,40 @@ word_list_traverse(struct word_list *wl, int (*fn)(const char *word, char *artic
 	return 0;
 }
 
-int
-word_list_rlookup(struct word_list *wl, bool (*selector)(const char *word, char *article), char *buffer, char *article)
+long
+word_list_select(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, long *ids)
+{
+	return word_list_select_except(wl, selector, data, NULL, ids, NULL);
+}
+
+long
+word_list_select_except(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, const uint64_t *skip, long *ids, bool *complete)
 {
-	long chosen[WORD_LIST_LOOKUP_RSET], nchosen, tries;
-	long i, selected_idx;
-	char _article[3], *selected_word;
+	long nchosen, tries, i;
+	char _article[3];
 	bool started_tries;
 
 	nchosen = tries = i = 0;
 	started_tries = false;
 	while (nchosen < WORD_LIST_LOOKUP_RSET && tries < WORD_LIST_LOOKUP_TRIES && i < wl->num_words) {
-		infer_article(wl->words[i], _article);
-		if (selector(wl->words[i], _article)) {
+		if (skip != NULL) {
+			if (i % 64 == 0 && skip[i / 64] == UINT64_MAX) {
+				i += 64;
+				continue;
+			}
+
+			if (WORD_LIST_BIT_TEST(skip, i)) {
+				++i;
+				continue;
+			}
+		}
+
+		article_at(wl, i, _article);
+		if (selector(WORD_LIST_WORD(wl, i), _article, data)) {
 			started_tries = true;
-			chosen[nchosen] = i;
+			ids[nchosen] = i;
 			++nchosen;
 		}
 
@@ -149,16 +849,30 @@ word_list_rlookup(struct word_list *wl, bool (*selector)(const char *word, char
 		++i;
 	}
 
-	if (!started_tries)
+	if (complete != NULL)
+		*complete = (i >= wl->num_words);
+
+	return nchosen;
+}
+
+int
+word_list_rlookup(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, unsigned int *seedp, char *buffer, char *article)
+{
+	long chosen[WORD_LIST_LOOKUP_RSET], nchosen;
+	long selected_idx;
+	const char *selected_word;
+
+	nchosen = word_list_select(wl, selector, data, chosen);
+	if (nchosen == 0)
 		return -1;
 
-	selected_idx = chosen[rand() % nchosen];
-	printf(">> nchosen=%ld idx=%ld rand=%ld\n", nchosen, selected_idx, rand() % nchosen);
-	selected_word = wl->words[selected_idx];
-	infer_article(selected_word, _article);
+	selected_idx = chosen[rand_r(seedp) % nchosen];
+	log_debug("nchosen=%ld idx=%ld", nchosen, selected_idx);
+	selected_word = WORD_LIST_WORD(wl, selected_idx);
 
 	strncpy(buffer, selected_word, strlen(selected_word) + 1);
-	strncpy(article, _article, 3);
+	article_at(wl, selected_idx, article);
 
 	return selected_idx;
 }
@@ -168,11 +882,719 @@ word_list_destroy(struct word_list *wl)
 {
 	ErrorCase(wl == NULL, EINVAL, -1);
 
+	/* the memory of snapshots belongs to the snapshot */
+	if (wl->words == NULL) {
+		if (wl->map != NULL)
+			ErrorCase(munmap(wl->map, wl->map_len) == -1, errno, -1);
+		wl->map = NULL;
+		return 0;
+	}
+
 	long i;
 	for (i = 0; i < wl->num_words; ++i) {
-		free(wl->words[i]);
+		allocator_release(wl->alloc, wl->words[i], WORD_LIST_LARGEST_NOUN);
+	}
+
+	allocator_release(wl->alloc, wl->words - wl->dropped, wl->size * sizeof(char *));
+	index_drop(wl);
+	return 0;
+}
+
+/* the article of the word at position `i`, which compiled dictionaries
+ * have at hand */
+static void
+article_at(const struct word_list *wl, long i, char *buf)
+{
+	if (wl->articles != NULL)
+		strncpy(buf, wl->articles[i] ? "an" : "a", 3);
+	else
+		word_list_article(wl->words[i], buf);
+}
+
+/* lays the list out as a compiled dictionary, in a single block of memory
+ * whose sections all start at a cache line. The list is indexed first, if
+ * needed. */
+static void *
+pack(struct word_list *wl, size_t *len)
+{
+	struct dictionary_header *h;
+	size_t strings_len = 0, n = wl->num_words;
+	uint32_t offset = 0, *offsets, *signatures;
+	uint8_t *articles;
+	char *base, article[3];
+	const char *word;
+	long i;
+
+	if (!wl->indexed && word_list_index(wl) == -1)
+		return NULL;
+
+	for (i = 0; i < wl->num_words; ++i)
+		strings_len += strlen(WORD_LIST_WORD(wl, i)) + 1;
+	ErrorCase(strings_len > UINT32_MAX, EINVAL, NULL);
+
+	*len = CACHE_ALIGN(sizeof(struct dictionary_header)) +
+		(wl->by_word != NULL ? CACHE_ALIGN(n * sizeof(long)) : 0) + CACHE_ALIGN(n * sizeof(long)) +
+		2 * CACHE_ALIGN(n * sizeof(uint32_t)) + CACHE_ALIGN(n) + CACHE_ALIGN(strings_len);
+
+	base = aligned_alloc(WORD_LIST_CACHE_LINE, *len);
+	ErrorCase(base == NULL, errno, NULL);
+	memset(base, 0, *len);
+
+	h = (struct dictionary_header *) base;
+	memcpy(h->magic, WORD_LIST_MAGIC, sizeof(WORD_LIST_MAGIC));
+	h->version = WORD_LIST_VERSION;
+	h->num_words = n;
+	h->size = *len;
+
+	h->by_suffix = CACHE_ALIGN(sizeof(struct dictionary_header));
+	if (wl->by_word != NULL) {
+		h->by_word = h->by_suffix;
+		h->by_suffix += CACHE_ALIGN(n * sizeof(long));
+		memcpy(&(base[h->by_word]), wl->by_word, n * sizeof(long));
+	}
+	memcpy(&(base[h->by_suffix]), wl->by_suffix, n * sizeof(long));
+
+	h->offsets = h->by_suffix + CACHE_ALIGN(n * sizeof(long));
+	h->signatures = h->offsets + CACHE_ALIGN(n * sizeof(uint32_t));
+	h->articles = h->signatures + CACHE_ALIGN(n * sizeof(uint32_t));
+	h->strings = h->articles + CACHE_ALIGN(n);
+
+	offsets = (uint32_t *) &(base[h->offsets]);
+	signatures = (uint32_t *) &(base[h->signatures]);
+	articles = (uint8_t *) &(base[h->articles]);
+
+	for (i = 0; i < wl->num_words; ++i) {
+		word = WORD_LIST_WORD(wl, i);
+		word_list_article(word, article);
+
+		offsets[i] = offset;
+		signatures[i] = word_list_signature(word);
+		articles[i] = (article[1] == 'n');
+		memcpy(&(base[h->strings + offset]), word, strlen(word) + 1);
+		offset += strlen(word) + 1;
+	}
+
+	return base;
+}
+
+/* whether the compiled dictionary of `len` bytes starting with header `h`
+ * can be attached: every section must be aligned for its items, and end
+ * within the dictionary. Words must be NUL-terminated before its end. */
+static bool
+dictionary_valid(const struct dictionary_header *h, size_t len)
+{
+	const char *base = (const char *) h;
+
+	if (len < sizeof(struct dictionary_header) || h->version != WORD_LIST_VERSION || h->size != len ||
+			h->num_words < 0 || h->by_suffix == 0)
+		return false;
+
+	if ((h->by_word != 0 && !section_fits(h->by_word, h->num_words, sizeof(long), len)) ||
+			!section_fits(h->by_suffix, h->num_words, sizeof(long), len) ||
+			!section_fits(h->offsets, h->num_words, sizeof(uint32_t), len) ||
+			!section_fits(h->signatures, h->num_words, sizeof(uint32_t), len) ||
+			!section_fits(h->articles, h->num_words, sizeof(uint8_t), len) ||
+			h->strings > len)
+		return false;
+
+	return h->num_words == 0 || (h->strings < len && base[len - 1] == '\0');
+}
+
+/* whether `count` items of `size` bytes, at `offset`, fit in `len` bytes */
+static bool
+section_fits(uint64_t offset, int64_t count, size_t size, size_t len)
+{
+	return offset <= len && offset % size == 0 && (uint64_t) count <= (len - offset) / size;
+}
+
+/* points the list at a compiled dictionary in memory */
+static void
+attach(struct word_list *wl, void *base)
+{
+	const struct dictionary_header *h = base;
+
+	wl->alloc = NULL;
+	wl->size = wl->num_words = h->num_words;
+	wl->dropped = 0;
+	wl->words = NULL;
+	wl->indexed = true;
+	wl->by_word = h->by_word != 0 ? (long *) ((char *) base + h->by_word) : NULL;
+	wl->by_suffix = (long *) ((char *) base + h->by_suffix);
+	wl->map = NULL;
+	wl->map_len = 0;
+	wl->offsets = (const uint32_t *) ((char *) base + h->offsets);
+	wl->signatures = (const uint32_t *) ((char *) base + h->signatures);
+	wl->articles = (const uint8_t *) ((char *) base + h->articles);
+	wl->strings = (const char *) base + h->strings;
+}
+
+/* where the chunk `i` of the input starts: at the beginning of the line
+ * following its share of the input */
+static const char *
+chunk_boundary(const char *input, size_t len, long i, long nthreads)
+{
+	size_t at = len / nthreads * i + len % nthreads * i / nthreads;
+	const char *nl;
+
+	if (i == 0 || at >= len)
+		return input + (i == 0 ? 0 : len);
+
+	nl = memchr(input + at, '\n', len - at);
+	return nl == NULL ? input + len : nl + 1;
+}
+
+/* the pipeline, as run by every thread */
+static void *
+prepare(void *arg)
+{
+	struct prep_thread *t = arg;
+	struct prep *p = t->prep;
+
+	pthread_mutex_lock(&p->gate);
+	pthread_mutex_unlock(&p->gate);
+	if (atomic_load(&p->err) != 0)
+		return NULL;
+
+	prep_normalize(t);
+	if (!prep_sync(p, prep_place))
+		return NULL;
+
+	prep_scatter(t);
+	if (!prep_sync(p, NULL))
+		return NULL;
+
+	prep_sort(t);
+	if (!prep_sync(p, prep_layout))
+		return NULL;
+
+	prep_fill(t);
+	if (!prep_sync(p, prep_place_suffixes))
+		return NULL;
+
+	prep_scatter_suffixes(t);
+	if (!prep_sync(p, NULL))
+		return NULL;
+
+	prep_sort_suffixes(t);
+	return NULL;
+}
+
+/* waits for every thread to finish the current stage, and has one of them
+ * run the `serial` step, if any. Returns whether the pipeline goes on. */
+static bool
+prep_sync(struct prep *p, int (*serial)(struct prep *p))
+{
+	if (pthread_barrier_wait(&p->barrier) == PTHREAD_BARRIER_SERIAL_THREAD &&
+			serial != NULL && atomic_load(&p->err) == 0 && serial(p) == -1)
+		atomic_store(&p->err, errno);
+
+	pthread_barrier_wait(&p->barrier);
+	return atomic_load(&p->err) == 0;
+}
+
+/* bucket of a word (or reversed word), by the first two letters of its
+ * prefix. Single letter words come before the longer words sharing their
+ * letter. */
+static long
+prep_bucket(uint64_t prefix)
+{
+	long first = (prefix >> 56) - 'a', second = (prefix >> 48) & 0xff;
+
+	return first * 27 + (second == 0 ? 0 : second - 'a' + 1);
+}
+
+/* the first 8 letters of `word`, in an integer that sorts as they do */
+static uint64_t
+prep_prefix(const char *word)
+{
+	uint64_t prefix = 0;
+	int i;
+
+	for (i = 0; i < 8; ++i) {
+		prefix = prefix << 8 | (unsigned char) *word;
+		if (*word != '\0')
+			++word;
+	}
+
+	return prefix;
+}
+
+/* stage 1: lowercases the words of the chunk, rejects the ones that are not
+ * made of letters only, reverses them and counts them by bucket */
+static void
+prep_normalize(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	const char *line, *nl, *last = NULL;
+	char *word, *reversed;
+	size_t len, i;
+
+	t->sorted = true;
+
+	/* every word takes at least two bytes of the input */
+	t->words = malloc(((t->end - t->begin) / 2 + 1) * sizeof(struct prep_word));
+	if (t->words == NULL) {
+		atomic_store(&p->err, errno);
+		return;
+	}
+
+	word = &(p->text[t->begin - p->input]);
+	for (line = t->begin; line < t->end; line = nl + 1) {
+		if ((nl = memchr(line, '\n', t->end - line)) == NULL)
+			nl = t->end;
+		++t->lines;
+
+		while (line < nl && isblank((unsigned char) *line))
+			++line;
+		for (len = nl - line; len > 0 && isspace((unsigned char) line[len - 1]); --len)
+			;
+
+		if (len == 0 || len >= WORD_LIST_LARGEST_NOUN) {
+			++t->rejected;
+			continue;
+		}
+
+		reversed = word + p->mirror;
+		for (i = 0; i < len; ++i) {
+			word[i] = tolower((unsigned char) line[i]);
+			if (word[i] < 'a' || word[i] > 'z')
+				break;
+
+			reversed[len - 1 - i] = word[i];
+		}
+
+		if (i < len) {
+			++t->rejected;
+			continue;
+		}
+
+		word[len] = reversed[len] = '\0';
+
+		if (last != NULL && strcmp(last, word) > 0)
+			t->sorted = false;
+		last = word;
+
+		t->words[t->num_words] = (struct prep_word) { prep_prefix(word), word, len, 0 };
+		++t->counts[prep_bucket(t->words[t->num_words].prefix)];
+		++t->num_words;
+
+		word += len + 1;
+	}
+}
+
+/* finds out where the words of each thread go, in every bucket: buckets keep
+ * the order of the input. The input is only sorted if each chunk is, and
+ * chunks follow one another. */
+static int
+prep_place(struct prep *p)
+{
+	struct prep_thread *t, *prev = NULL;
+	long b, i, pos = 0;
+
+	for (b = 0; b < PREP_BUCKETS; ++b) {
+		p->start[b] = pos;
+		for (i = 0; i < p->nthreads; ++i) {
+			p->threads[i].cursors[b] = pos;
+			pos += p->threads[i].counts[b];
+		}
+	}
+	p->start[PREP_BUCKETS] = pos;
+
+	for (i = 0; i < p->nthreads; ++i) {
+		t = &(p->threads[i]);
+		if (t->num_words == 0)
+			continue;
+
+		if (prev != NULL && strcmp(prev->words[prev->num_words - 1].word, t->words[0].word) > 0)
+			t->sorted = false;
+		prev = t;
+	}
+
+	p->words = malloc((pos > 0 ? pos : 1) * sizeof(struct prep_word));
+	ErrorCase(p->words == NULL, errno, -1);
+
+	atomic_store(&p->next, 0);
+	return 0;
+}
+
+/* stage 2: moves the words of the chunk to their buckets */
+static void
+prep_scatter(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	long i;
+
+	for (i = 0; i < t->num_words; ++i)
+		p->words[t->cursors[prep_bucket(t->words[i].prefix)]++] = t->words[i];
+}
+
+/* stage 3: sorts the buckets and drops the repeated words */
+static void
+prep_sort(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	struct prep_word *words;
+	long b, i, n, unique;
+
+	while ((b = atomic_fetch_add(&p->next, 1)) < PREP_BUCKETS) {
+		words = &(p->words[p->start[b]]);
+		n = p->start[b + 1] - p->start[b];
+
+		if (prep_sort_bucket(t, words, n) == -1) {
+			atomic_store(&p->err, errno);
+			return;
+		}
+
+		p->bytes[b] = 0;
+		for (i = 0, unique = 0; i < n; ++i) {
+			if (unique > 0 && compare_prep_words(&words[unique - 1], &words[i]) == 0)
+				continue;
+
+			words[unique++] = words[i];
+			p->bytes[b] += words[i].len + 1;
+		}
+
+		t->duplicates += n - unique;
+		p->unique[b] = unique;
+	}
+}
+
+/* lays the list out, as `pack` does: every word now has its position */
+static int
+prep_layout(struct prep *p)
+{
+	struct dictionary_header *h;
+	size_t strings_len = 0;
+	long b, n = 0;
+
+	for (b = 0; b < PREP_BUCKETS; ++b) {
+		p->first_id[b] = n;
+		p->first_byte[b] = strings_len;
+		n += p->unique[b];
+		strings_len += p->bytes[b];
+	}
+	ErrorCase(strings_len > UINT32_MAX, EINVAL, -1);
+
+	p->len = CACHE_ALIGN(sizeof(struct dictionary_header)) + CACHE_ALIGN(n * sizeof(long)) +
+		2 * CACHE_ALIGN(n * sizeof(uint32_t)) + CACHE_ALIGN(n) + CACHE_ALIGN(strings_len);
+
+	/* anonymous memory is zeroed, and released as mapped lists are */
+	p->base = mmap(NULL, p->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p->base == MAP_FAILED) {
+		p->base = NULL;
+		return -1;
+	}
+
+	h = (struct dictionary_header *) p->base;
+	memcpy(h->magic, WORD_LIST_MAGIC, sizeof(WORD_LIST_MAGIC));
+	h->version = WORD_LIST_VERSION;
+	h->num_words = n;
+	h->size = p->len;
+	h->by_word = 0;
+	h->by_suffix = CACHE_ALIGN(sizeof(struct dictionary_header));
+	h->offsets = h->by_suffix + CACHE_ALIGN(n * sizeof(long));
+	h->signatures = h->offsets + CACHE_ALIGN(n * sizeof(uint32_t));
+	h->articles = h->signatures + CACHE_ALIGN(n * sizeof(uint32_t));
+	h->strings = h->articles + CACHE_ALIGN(n);
+
+	p->by_suffix = (long *) (p->base + h->by_suffix);
+	p->offsets = (uint32_t *) (p->base + h->offsets);
+	p->signatures = (uint32_t *) (p->base + h->signatures);
+	p->articles = (uint8_t *) (p->base + h->articles);
+	p->strings = p->base + h->strings;
+
+	atomic_store(&p->next, 0);
+	return 0;
+}
+
+/* stage 4: copies the words of the buckets to the list, with their articles
+ * and letter signatures. Their prefixes become those of the reversed words,
+ * which are counted by bucket. */
+static void
+prep_fill(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	struct prep_word *w;
+	const char *word;
+	char article[3], unpacked[8];
+	size_t off;
+	uint64_t prefix;
+	uint32_t signature;
+	long b, i, j;
+
+	memset(t->counts, 0, sizeof(t->counts));
+
+	while ((b = atomic_fetch_add(&p->next, 1)) < PREP_BUCKETS) {
+		p->owner[b] = t->id;
+		off = p->first_byte[b];
+
+		for (i = 0; i < p->unique[b]; ++i) {
+			w = &(p->words[p->start[b] + i]);
+			w->id = p->first_id[b] + i;
+
+			/* short words are whole in their prefixes, which saves
+			 * reaching the input for them */
+			word = w->word;
+			if (w->len <= 8) {
+				for (j = 0; j < 8; ++j)
+					unpacked[j] = w->prefix >> (56 - 8 * j);
+				word = unpacked;
+			}
+
+			memcpy(&(p->strings[off]), word, w->len);
+			p->offsets[w->id] = off;
+			off += w->len + 1;
+
+			word_list_article(word, article);
+			p->articles[w->id] = (article[1] == 'n');
+
+			signature = 0;
+			prefix = 0;
+			for (j = w->len - 1; j >= 0; --j) {
+				signature |= WORD_LIST_LETTER(word[j]);
+				if (j >= (long) w->len - 8)
+					prefix = prefix << 8 | (unsigned char) word[j];
+			}
+			p->signatures[w->id] = signature;
+
+			if (w->len < 8)
+				prefix <<= 8 * (8 - w->len);
+			w->prefix = prefix;
+			++t->counts[prep_bucket(prefix)];
+		}
+	}
+}
+
+static int
+prep_place_suffixes(struct prep *p)
+{
+	long b, i, pos = 0;
+
+	for (b = 0; b < PREP_BUCKETS; ++b) {
+		p->suffix_start[b] = pos;
+		for (i = 0; i < p->nthreads; ++i) {
+			p->threads[i].cursors[b] = pos;
+			pos += p->threads[i].counts[b];
+		}
+	}
+	p->suffix_start[PREP_BUCKETS] = pos;
+
+	p->suffixes = malloc((pos > 0 ? pos : 1) * sizeof(struct prep_word));
+	ErrorCase(p->suffixes == NULL, errno, -1);
+
+	atomic_store(&p->next, 0);
+	return 0;
+}
+
+/* stage 5: moves the reversed words of the buckets laid out by this thread
+ * to their own buckets */
+static void
+prep_scatter_suffixes(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	struct prep_word *w;
+	long b, i;
+
+	for (b = 0; b < PREP_BUCKETS; ++b) {
+		if (p->owner[b] != t->id)
+			continue;
+
+		for (i = 0; i < p->unique[b]; ++i) {
+			w = &(p->words[p->start[b] + i]);
+			p->suffixes[t->cursors[prep_bucket(w->prefix)]++] =
+				(struct prep_word) { w->prefix, w->word + p->mirror, w->len, w->id };
+		}
+	}
+}
+
+/* stage 6: sorts the buckets of reversed words into the suffix index */
+static void
+prep_sort_suffixes(struct prep_thread *t)
+{
+	struct prep *p = t->prep;
+	long b, i;
+
+	while ((b = atomic_fetch_add(&p->next, 1)) < PREP_BUCKETS) {
+		if (prep_sort_bucket(t, &(p->suffixes[p->suffix_start[b]]), p->suffix_start[b + 1] - p->suffix_start[b]) == -1) {
+			atomic_store(&p->err, errno);
+			return;
+		}
+
+		for (i = p->suffix_start[b]; i < p->suffix_start[b + 1]; ++i)
+			p->by_suffix[i] = p->suffixes[i].id;
+	}
+}
+
+/* sorts the `n` words of a bucket, unless they are sorted already: a radix
+ * sort on their prefixes (the first two letters are those of the bucket),
+ * and then a comparison sort of the words sharing a prefix, if any */
+static int
+prep_sort_bucket(struct prep_thread *t, struct prep_word *words, long n)
+{
+	struct prep_word *from = words, *to, *swap;
+	long counts[256], pos[256], i, j;
+	int shift;
+
+	for (i = 1; i < n; ++i)
+		if (compare_prep_words(&words[i - 1], &words[i]) > 0)
+			break;
+	if (i >= n)
+		return 0;
+
+	if (n > t->scratch_len) {
+		swap = realloc(t->scratch, n * sizeof(struct prep_word));
+		ErrorCase(swap == NULL, errno, -1);
+
+		t->scratch = swap;
+		t->scratch_len = n;
+	}
+	to = t->scratch;
+
+	for (shift = 0; shift < 48; shift += 8) {
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < n; ++i)
+			++counts[(from[i].prefix >> shift) & 0xff];
+
+		/* every word has the same letter here */
+		if (counts[(from[0].prefix >> shift) & 0xff] == n)
+			continue;
+
+		for (i = 0, j = 0; i < 256; j += counts[i++])
+			pos[i] = j;
+		for (i = 0; i < n; ++i)
+			to[pos[(from[i].prefix >> shift) & 0xff]++] = from[i];
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != words)
+		memcpy(words, from, n * sizeof(struct prep_word));
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && words[j].prefix == words[i].prefix; ++j)
+			;
+		if (j - i > 1 && (words[i].prefix & 0xff) != 0)
+			qsort(&words[i], j - i, sizeof(struct prep_word), compare_prep_words);
 	}
 
-	free(wl->words);
 	return 0;
 }
+
+static int
+compare_prep_words(const void *a, const void *b)
+{
+	const struct prep_word *wa = a, *wb = b;
+
+	if (wa->prefix != wb->prefix)
+		return wa->prefix < wb->prefix ? -1 : 1;
+
+	return strcmp(wa->word, wb->word);
+}
+
+static void
+index_drop(struct word_list *wl)
+{
+	if (!wl->indexed && wl->by_word == NULL && wl->by_suffix == NULL)
+		return;
+
+	/* the list has not changed since the indexes were built */
+	allocator_release(wl->alloc, wl->by_word, wl->num_words * sizeof(long));
+	allocator_release(wl->alloc, wl->by_suffix, wl->num_words * sizeof(long));
+	wl->by_word = wl->by_suffix = NULL;
+	wl->indexed = false;
+}
+
+/* compares the last (at most) `n` characters of `a` and `b`, backwards. A word
+ * that runs out of characters first comes first. */
+static int
+rcompare(const char *a, const char *b, size_t n)
+{
+	size_t i = strlen(a), j = strlen(b);
+
+	for (; n > 0; --n) {
+		if (i == 0 || j == 0)
+			return (i > 0) - (j > 0);
+
+		--i; --j;
+		if (a[i] != b[j])
+			return (unsigned char) a[i] - (unsigned char) b[j];
+	}
+
+	return 0;
+}
+
+static int
+compare_keyed(const void *a, const void *b)
+{
+	return strcmp(((const struct keyed_id *) a)->word, ((const struct keyed_id *) b)->word);
+}
+
+static int
+compare_keyed_reversed(const void *a, const void *b)
+{
+	return rcompare(((const struct keyed_id *) a)->word, ((const struct keyed_id *) b)->word, SIZE_MAX);
+}
+
+/* returns the word positions, sorted by `compare` */
+static long *
+sorted_ids(const struct word_list *wl, int (*compare)(const void *a, const void *b))
+{
+	struct keyed_id *keyed;
+	long *ids, i;
+
+	keyed = allocator_alloc(wl->alloc, wl->num_words * sizeof(struct keyed_id));
+	ids = allocator_alloc(wl->alloc, wl->num_words * sizeof(long));
+	if (keyed == NULL || ids == NULL) {
+		allocator_release(wl->alloc, keyed, wl->num_words * sizeof(struct keyed_id));
+		allocator_release(wl->alloc, ids, wl->num_words * sizeof(long));
+		return NULL;
+	}
+
+	for (i = 0; i < wl->num_words; ++i) {
+		keyed[i].word = WORD_LIST_WORD(wl, i);
+		keyed[i].id = i;
+	}
+
+	qsort(keyed, wl->num_words, sizeof(struct keyed_id), compare);
+
+	for (i = 0; i < wl->num_words; ++i)
+		ids[i] = keyed[i].id;
+
+	allocator_release(wl->alloc, keyed, wl->num_words * sizeof(struct keyed_id));
+	return ids;
+}
+
+/* binary search for the first entry of `order` whose word compares (on its
+ * first, or last when `reversed`, `n` characters) greater than or equal to
+ * `key` or, if `upper`, strictly greater */
+static long
+bound(const struct word_list *wl, const long *order, const char *key, size_t n, bool upper, bool reversed)
+{
+	long lo = 0, hi = wl->num_words, mid;
+	const char *word;
+	int c;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		word = WORD_LIST_WORD(wl, order != NULL ? order[mid] : mid);
+		c = reversed ? rcompare(word, key, n) : strncmp(word, key, n);
+
+		if (c < 0 || (upper && c == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void
+span_of(const struct word_list *wl, const long *order, const char *key, size_t n, bool reversed,
+		struct word_list_span *span)
+{
+	span->order = order;
+	span->first = bound(wl, order, key, n, false, reversed);
+	span->count = bound(wl, order, key, n, true, reversed) - span->first;
+}
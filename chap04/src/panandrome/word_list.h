@@ -1,5 +1,19 @@
 /* wordlist - allows loading large word lists and perform lookups
- * on it based on prefix, suffix, or absolute match. */
+ * on it based on prefix, suffix, or absolute match.
+ *
+ * A word list can also be saved, alongside its articles and indexes, as a
+ * compiled dictionary (see the word_list_compile tool), which is later
+ * mapped back to memory as it is, instead of parsed:
+ *
+ * 	header:   magic ("PANDICT"), version, number of words, and the offset
+ * 	          of every section in the file
+ * 	sections: the alphabetical and suffix indexes (64-bit positions), the
+ * 	          offsets of the words (32-bit), their letter signatures
+ * 	          (32-bit, see `word_list_signature`), the articles (one byte
+ * 	          per word, 1 for "an") and the NUL-terminated words, packed
+ *
+ * Numbers are in the native byte order: dictionaries are meant to be compiled
+ * on the machine that uses them. */
 
 #ifndef WORD_LIST_H
 #define WORD_LIST_H
@@ -18,28 +32,102 @@
 #  define WORD_LIST_LOOKUP_TRIES (500)
 #endif
 
-#define _XOPEN_SOURCE
+#ifndef _XOPEN_SOURCE
+#  define _XOPEN_SOURCE 700
+#endif
+
+#define WORD_LIST_MAGIC   ("PANDICT")
+#define WORD_LIST_VERSION (2)
+
+/* snapshots, and the sections of compiled dictionaries, are aligned to the
+ * cache line, so that data read by many threads never shares a line with
+ * data that is written */
+#ifndef WORD_LIST_CACHE_LINE
+#  define WORD_LIST_CACHE_LINE (64)
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "allocator.h"
+
+/* sets of word positions (e.g., the words already used by a search) are kept
+ * as bitsets: one bit per word, in blocks of 64 words */
+#define WORD_LIST_BLOCKS(n)        (((n) + 63) / 64)
+#define WORD_LIST_BIT_TEST(set, i)  (((set)[(i) / 64] >> ((i) % 64)) & 1)
+#define WORD_LIST_BIT_SET(set, i)   ((set)[(i) / 64] |= (UINT64_C(1) << ((i) % 64)))
+#define WORD_LIST_BIT_CLEAR(set, i) ((set)[(i) / 64] &= ~(UINT64_C(1) << ((i) % 64)))
 
 struct word_list {
+	struct allocator *alloc; /* of the words and indexes; NULL for the system one */
+
 	long size;      /* maximum number of words allowed in this list */
 	long num_words; /* number of words loaded in the struct */
 	char **words;   /* list of NUL-terminated strings */
+	long dropped;   /* slots before `words`, freed by removing the first word */
+
+	/* query indexes, built by `word_list_index`: word positions in
+	 * alphabetical order (NULL if the list is already sorted), and in the
+	 * alphabetical order of the reversed words */
+	bool indexed;
+	long *by_word;
+	long *by_suffix;
+
+	/* set when the list is packed as a compiled dictionary, either mapped
+	 * from a file (`map`) or frozen in a snapshot: `words` is then NULL, the
+	 * list is read-only and the words are packed in `strings`, at `offsets` */
+	void *map;
+	size_t map_len;
+	const char *strings;
+	const uint32_t *offsets;
+	const uint32_t *signatures;
+	const uint8_t *articles;
+};
+
+/* the word at position `i` of the list, whether it is packed or not */
+#define WORD_LIST_WORD(wl, i) \
+	((wl)->words != NULL ? (const char *) (wl)->words[i] : &((wl)->strings[(wl)->offsets[i]]))
+
+/* the bit of letter `c` in a letter signature */
+#define WORD_LIST_LETTER(c) (UINT32_C(1) << ((c) - 'a'))
+
+/* the words matching a query, as a range of `count` entries starting at
+ * `first` in `order`, which holds word positions. When `order` is NULL, the
+ * matching words are the ones at positions `first` to `first + count - 1`. */
+struct word_list_span {
+	const long *order;
+	long first, count;
 };
 
+/* position in the list of the `i`-th word in a span */
+#define WORD_LIST_SPAN_ID(span, i) \
+	((span)->order != NULL ? (span)->order[(span)->first + (i)] : (span)->first + (i))
+
 /* initializes a previously allocated `word_list` struct. The struct will support
  * a maximum of `size` words in it.
  *
  * Returns a positive number on success, -1 on error */
 int word_list_init(struct word_list *wl, long size);
 
+/* same as `word_list_init`, but the list, its words (blocks of
+ * WORD_LIST_LARGEST_NOUN bytes) and its indexes are taken from `alloc`, which
+ * must outlive the list */
+int word_list_init_with(struct word_list *wl, long size, struct allocator *alloc);
+
+/* changes the maximum number of words of the list to `size`, which must fit
+ * the words already in it. Packed lists cannot be resized.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_resize(struct word_list *wl, long size);
+
 /* appends a given `word` to the word list. The passed buffer is not modified
  * and can be later changed without affecting the list structure. */
 int word_list_append(struct word_list *wl, const char *word);
@@ -62,18 +150,189 @@ int word_list_add_at(struct word_list *wl, const char *word, long p);
  * appropriately. */
 int word_list_load(struct word_list *wl, FILE *stream);
 
+/* saves the list, indexing it first if needed, as a compiled dictionary at
+ * `path`. The file is replaced atomically.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_save(struct word_list *wl, const char *path);
+
+/* maps the compiled dictionary at `path` as a read-only, indexed, list. The
+ * file contents are trusted to have been written by `word_list_save`: only
+ * the header, and the bounds of the sections it points at, are validated.
+ * Trying to change the list fails with EPERM.
+ *
+ * Returns a positive number on success, or -1 on error, with errno set to
+ * EINVAL if the file is not a compiled dictionary, or to EBADMSG if it starts
+ * as one but is truncated, corrupt or of another version. */
+int word_list_open(struct word_list *wl, const char *path);
+
+/* loads the nouns list at `path`, which is either a compiled dictionary,
+ * mapped with `word_list_open`, or a text list, which is preprocessed with
+ * `word_list_prepare`. Files that start as compiled dictionaries are never
+ * taken for text lists: if they cannot be opened, loading fails.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_load_path(struct word_list *wl, const char *path);
+
+struct word_list_prep {
+	long lines;      /* read from the text list */
+	long rejected;   /* empty, too long, or not made of letters only */
+	long duplicates; /* dropped, once lowercased */
+	bool sorted;     /* whether the accepted words were already in order */
+};
+
+/* loads the text list at `path` (one noun per line) into a packed, indexed,
+ * read-only list, as `word_list_open` would a compiled dictionary. Words are
+ * lowercased; the ones that are not made of letters only are rejected, and
+ * duplicates dropped. Letter signatures are computed along with the articles.
+ *
+ * The work is split among `nthreads` threads (one per online processor if
+ * not positive): the input is cut in chunks, at line boundaries, normalized
+ * in parallel and spread over buckets by first letters, which are sorted
+ * and laid out in parallel as well. The suffix index is built the same way.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_prepare(struct word_list *wl, const char *path, long nthreads, struct word_list_prep *stats);
+
+/* an immutable copy of a word list, meant to be shared by any number of
+ * threads: the list is packed, indexes included, in a single cache line
+ * aligned block, laid out as a compiled dictionary. Data derived from the
+ * list (e.g., its closure graph) can be attached to the snapshot, and is
+ * released along with it by `release`, unless NULL. */
+struct word_list_snapshot {
+	struct word_list list;
+	void *arena;
+	unsigned long generation; /* of the slot it was published in */
+	struct word_list_snapshot *next; /* retired along with it */
+
+	void *data;
+	void (*release)(void *data);
+};
+
+/* a published snapshot, which can be replaced while it is being read.
+ * Readers never wait nor take locks: they announce themselves on the counter
+ * of the parity of the generation they started in. A swap publishes the new
+ * snapshot in the other parity and retires the old one, which is released
+ * by the last reader to leave its counter. Each counter takes a cache line
+ * of its own. */
+struct word_list_slot {
+	_Atomic(struct word_list_snapshot *) published[2]; /* by parity */
+	atomic_ulong generation;
+	struct {
+		_Alignas(WORD_LIST_CACHE_LINE) atomic_long n;
+	} readers[2];
+
+	/* snapshots no longer published, still read by someone */
+	_Atomic(struct word_list_snapshot *) retired[2];
+	pthread_mutex_t lock; /* serializes swaps and releases */
+};
+
+/* packs the list, indexing it first if needed, into a new snapshot. The list
+ * itself is not changed, and can be destroyed afterwards.
+ *
+ * Returns the snapshot, or NULL on error */
+struct word_list_snapshot *word_list_freeze(struct word_list *wl);
+
+/* releases the snapshot, and its attached data */
+void word_list_snapshot_free(struct word_list_snapshot *snap);
+
+/* publishes `snap` as the first generation of the slot.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_slot_init(struct word_list_slot *slot, struct word_list_snapshot *snap);
+
+/* returns the current snapshot of the slot, which stays valid until
+ * `word_list_slot_exit` is called with the same `ticket` */
+struct word_list_snapshot *word_list_slot_enter(struct word_list_slot *slot, unsigned long *ticket);
+void word_list_slot_exit(struct word_list_slot *slot, unsigned long ticket);
+
+/* publishes `snap` in place of the current snapshot, without waiting for
+ * anyone. Readers that enter the slot afterwards get the new snapshot; the
+ * old one is released by the last reader of it to leave the slot (or right
+ * away, if there is none). Note that readers of a later generation of the
+ * same parity may delay the release.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_slot_swap(struct word_list_slot *slot, struct word_list_snapshot *snap);
+
+/* releases the current snapshot of the slot, and the retired ones. No reader
+ * may be left. */
+int word_list_slot_destroy(struct word_list_slot *slot);
+
 /* performs a lookup of a given word according to the results of the passed `selector`.
  * In case the selector returns `true`, then the search will proced to the following
  * words until `WORD_LIST_LOOKUP_RSET` words that pass the criteria are found, or
  * more than `WORD_LIST_LOOKUP_TRIES` are searched. A random word from the set that
- * passed the `comparator` test will be chosen and copied to the given `buffer`,
+ * passed the `selector` test will be chosen and copied to the given `buffer`,
  * alongside the companion `article`. In that sense, the return of this function is
  * not deterministic (assuming a perfectly random function is available, which is
  * beyond the scope here).
  *
+ * The opaque `data` pointer is handed to every `selector` call, and the random
+ * choice is made with `rand_r(3)` on the given `seedp`. The list is only read,
+ * so concurrent lookups on the same list are safe as long as each caller owns
+ * its `data` and `seedp`.
+ *
  * In case no word that matches the criteria is found, -1 is returned and the buffer
  * is not modified. */
-int word_list_rlookup(struct word_list *wl, bool (*comparator)(const char *word, char *article), char *buffer, char *article);
+int word_list_rlookup(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, unsigned int *seedp, char *buffer, char *article);
+
+/* collects the candidates `word_list_rlookup` would choose from: the positions
+ * of up to `WORD_LIST_LOOKUP_RSET` words accepted by `selector` are stored in
+ * `ids`, which must have room for that many.
+ *
+ * Returns the number of candidates found. */
+long word_list_select(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, long *ids);
+
+/* same as `word_list_select`, but words whose bit is set in the `skip`
+ * bitset (of `WORD_LIST_BLOCKS(wl->num_words)` blocks) are never given to
+ * the `selector`, nor count as tries. Blocks with all 64 bits set are skipped
+ * at once. `skip` may be NULL.
+ *
+ * When `complete` is given, it is set to whether the whole list was scanned,
+ * that is, whether `ids` holds every word accepted by the `selector`: the
+ * scan stops early once enough words are found, or too many were tried. */
+long word_list_select_except(struct word_list *wl, bool (*selector)(const char *word, char *article, void *data),
+		void *data, const uint64_t *skip, long *ids, bool *complete);
+
+/* builds the indexes used by the queries below. Changing the list (adding
+ * or removing words) drops the indexes, so this is meant to be called once
+ * the list is completely loaded.
+ *
+ * Returns a positive number on success, -1 on error */
+int word_list_index(struct word_list *wl);
+
+/* find the words equal to `word`, the words starting with `prefix`, and the
+ * words ending with `suffix`, by binary search on the indexes. The matches are
+ * stored in `span`, in alphabetical order (of the reversed words, for suffix
+ * queries). No article is taken into account.
+ *
+ * Return a positive number on success, or -1 with errno set to EINVAL if the
+ * list was not indexed. */
+int word_list_exact(const struct word_list *wl, const char *word, struct word_list_span *span);
+int word_list_prefix(const struct word_list *wl, const char *prefix, struct word_list_span *span);
+int word_list_suffix(const struct word_list *wl, const char *suffix, struct word_list_span *span);
+
+/* iterates over the words of `span` whose bit is not set in the `skip` bitset
+ * (as in `word_list_select_except`; NULL skips nothing). `cursor` holds the
+ * position of the iteration in the span, and must start at 0. When the span
+ * is a range of positions (`order` is NULL), blocks of the bitset with all 64
+ * bits set are skipped at once.
+ *
+ * Returns the position in the list of the next word, or -1 once the span is
+ * exhausted. */
+long word_list_span_next(const struct word_list_span *span, const uint64_t *skip, long *cursor);
+
+/* the set of letters of `word`, as a bitset of `WORD_LIST_LETTER`s: words
+ * whose signatures lack a letter can be passed over by queries that need it
+ * without comparing strings. Packed lists keep the signature of every word. */
+uint32_t word_list_signature(const char *word);
+
+/* writes to `buf` the article ("a" or "an") that precedes the given `word`.
+ * `buf` must be at least 3 bytes long. */
+void word_list_article(const char *word, char *buf);
 
 /* traverses the word list, calling the specified callback `fn` for each word on
  * the list. The callback receives as arguments the current word, the related article
@@ -0,0 +1,50 @@
+/* word_list_compile.c - compiles a nouns list for panandrome.
+ *
+ * Reads a text nouns list, with one word per line, and saves it as a
+ * compiled dictionary (see word_list.h): the words, their articles and the
+ * query indexes, ready to be mapped to memory by `word_list_open`. Starting
+ * panandrome from a compiled dictionary takes no parsing, and processes
+ * using the same dictionary share its pages.
+ *
+ * Usage:
+ *
+ * 	$ ./word_list_compile <nouns_list> <dictionary>
+ *
+ * 	nouns_list - a text file of nouns, with one word per line.
+ * 	dictionary - where to save the compiled dictionary.
+ */
+
+#include "word_list.h"
+
+static char *progname = "word_list_compile";
+
+static void pexit(const char *fname);
+
+int
+main(int argc, char *argv[])
+{
+	struct word_list nouns;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <nouns_list> <dictionary>\n", progname);
+		exit(EXIT_FAILURE);
+	}
+
+	if (word_list_load_path(&nouns, argv[1]) == -1)
+		pexit("word_list_load_path");
+
+	if (word_list_save(&nouns, argv[2]) == -1)
+		pexit("word_list_save");
+
+	printf("%s: %ld words compiled to %s\n", progname, nouns.num_words, argv[2]);
+	word_list_destroy(&nouns);
+
+	exit(EXIT_SUCCESS);
+}
+
+static void
+pexit(const char *fname)
+{
+	perror(fname);
+	exit(EXIT_FAILURE);
+}
@@ -11,15 +11,49 @@
  *
  * This program determines when will time_t wrap and then print the date
  * on the standard output. It will also calculate how long the UNIX Demon
- * should be hunting based on the current time.
+ * should be hunting based on the current time. Since time_t is not the only
+ * way timestamps are stored (binary logs often keep them as 32 or 64-bit,
+ * signed or unsigned, integers of seconds, milliseconds, microseconds or
+ * nanoseconds), the earliest and latest dates each of these formats can hold
+ * are listed as well. They are computed by the compiler.
+ *
+ * It can also convert streams of epoch timestamps (e.g., taken from logs) to
+ * UTC dates, in bulk. Conversions do not go through gmtime(3), which keeps
+ * its result in a static buffer and handles a single value per call: days
+ * are turned into civil dates with integer arithmetic only (after Howard
+ * Hinnant's "chrono-Compatible Low-Level Date Algorithms"), on arrays of
+ * timestamps at a time, with no branches in the loop. Every 64-bit value,
+ * negative ones included, is converted.
+ *
+ * Usage:
+ *
+ *   $ cc -O2 -pthread -o time_t_wrap time_t_wrap.c
+ *   $ ./time_t_wrap
+ *   $ ./time_t_wrap -c [-b] [-j <threads>] [<file>]
+ *   $ ./time_t_wrap -t <values> [-j <threads>]
+ *
+ *   -c - convert the timestamps in the given file (or in the standard input)
+ *        to ISO 8601 UTC dates ("1970-01-01T00:00:00Z"), one per line.
+ *   -b - timestamps are 64-bit integers, in the native byte order. Otherwise,
+ *        they are decimal numbers, one per line.
+ *   threads - number of threads converting each batch. Defaults to 1.
+ *   values - check the conversions against gmtime_r(3) and timegm(3) on
+ *            the given number of random timestamps, in each of several
+ *            ranges, and time both (with as many threads).
  *
  * Author: Renato Mascarenhas
  */
 
+#define _DEFAULT_SOURCE /* timegm(3) */
+
 #include <time.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #define MINUTE (60)
 #define HOUR   (60 * MINUTE)
@@ -28,13 +62,181 @@
 #define MONTH  (30 * DAY)
 #define YEAR   (365 * DAY)
 
-void printInfo(const char *name, double *seconds, int period);
+/* timestamps converted at once, and the longest date written for one of them
+ * (a 64-bit year takes up to 12 characters) */
+#define BATCH      (1 << 16)
+#define DATE_LEN   (32)
+#define MAXTHREADS (256)
+
+/* a broken down UTC time. Unlike `struct tm`, the year is the actual year
+ * (negative before 1 BC, which is year 0) and months start at 1. */
+struct civil_time {
+  int64_t year;
+  int month;   /* [1, 12] */
+  int day;     /* [1, 31] */
+  int hour;    /* [0, 23] */
+  int minute;  /* [0, 59] */
+  int second;  /* [0, 59] */
+  int weekday; /* [0, 6], from Sunday */
+  int yearday; /* [0, 365] */
+};
+
+/* floor division and modulo (for positive `b`), as constant expressions.
+ * The modulo is taken without multiplying the quotient back, which could
+ * overflow. */
+#define FDIV(a, b) ((a) / (b) - ((a) % (b) < 0))
+#define FMOD(a, b) (((a) % (b) + (b)) % (b))
+
+/* the days-to-civil algorithm of `epochToCivilBatch`, spelled out as macros
+ * on the number of days since the epoch, so that the compiler can evaluate
+ * it on constants */
+#define CT_Z(d)     ((d) + 719468)
+#define CT_ERA(d)   FDIV(CT_Z(d), 146097)
+#define CT_DOE(d)   (CT_Z(d) - CT_ERA(d) * 146097)
+#define CT_YOE(d)   ((CT_DOE(d) - CT_DOE(d) / 1460 + CT_DOE(d) / 36524 - CT_DOE(d) / 146096) / 365)
+#define CT_DOY(d)   (CT_DOE(d) - (365 * CT_YOE(d) + CT_YOE(d) / 4 - CT_YOE(d) / 100))
+#define CT_MP(d)    ((5 * CT_DOY(d) + 2) / 153)
+#define CT_MONTH(d) (CT_MP(d) + 3 - 12 * (CT_MP(d) >= 10))
+#define CT_DAY(d)   (CT_DOY(d) - (153 * CT_MP(d) + 2) / 5 + 1)
+#define CT_YEAR(d)  (CT_YOE(d) + CT_ERA(d) * 400 + (CT_MONTH(d) <= 2))
+
+/* an instant, as a count of `scale` units since the epoch */
+struct instant {
+  int64_t year;
+  int month, day, hour, minute, second;
+  int64_t fraction; /* units past the second */
+};
+
+#define INSTANT(days, secs, frac) \
+  { CT_YEAR(days), CT_MONTH(days), CT_DAY(days), (secs) / HOUR, (secs) % HOUR / MINUTE, (secs) % MINUTE, (frac) }
+
+#define SIGNED_AT(v, scale) \
+  INSTANT(FDIV(FDIV((int64_t) (v), (scale)), DAY), FMOD(FDIV((int64_t) (v), (scale)), DAY), FMOD((int64_t) (v), (scale)))
+
+#define UNSIGNED_AT(v, scale) \
+  INSTANT((int64_t) ((uint64_t) (v) / (scale) / DAY), (int64_t) ((uint64_t) (v) / (scale) % DAY), (int64_t) ((uint64_t) (v) % (scale)))
+
+/* range of dates a timestamp format can hold */
+struct wrap {
+  const char *type;
+  const char *unit;
+  int digits; /* of the fraction of a second */
+  struct instant earliest, latest;
+};
+
+#define SIGNED_WRAP(type, min, max, unit, scale, digits) \
+  { type, unit, digits, SIGNED_AT(min, scale), SIGNED_AT(max, scale) }
+
+#define UNSIGNED_WRAP(type, max, unit, scale, digits) \
+  { type, unit, digits, UNSIGNED_AT(0, scale), UNSIGNED_AT(max, scale) }
+
+#define WRAPS(scale, unit, digits) \
+  SIGNED_WRAP("int32", INT32_MIN, INT32_MAX, unit, scale, digits), \
+  UNSIGNED_WRAP("uint32", UINT32_MAX, unit, scale, digits), \
+  SIGNED_WRAP("int64", INT64_MIN, INT64_MAX, unit, scale, digits), \
+  UNSIGNED_WRAP("uint64", UINT64_MAX, unit, scale, digits)
+
+static const struct wrap wraps[] = {
+  WRAPS(INT64_C(1), "s", 0),
+  WRAPS(INT64_C(1000), "ms", 3),
+  WRAPS(INT64_C(1000000), "us", 6),
+  WRAPS(INT64_C(1000000000), "ns", 9),
+};
+
+/* the UNIX Demon is still on schedule */
+_Static_assert(CT_YEAR(FDIV((int64_t) INT32_MAX, DAY)) == 2038 && CT_MONTH(FDIV((int64_t) INT32_MAX, DAY)) == 1 &&
+    CT_DAY(FDIV((int64_t) INT32_MAX, DAY)) == 19, "days-to-civil macros are broken");
+
+static const char *weekdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+/* a slice of a batch, converted by a single thread */
+struct slice {
+  pthread_t thread;
+  const int64_t *epochs;
+  size_t n;
+  struct civil_time *civil;
+  char *out;     /* DATE_LEN bytes per timestamp */
+  size_t outlen; /* bytes written to `out` */
+};
+
+/* what `benchmark` runs on each thread */
+enum bench_method { BENCH_CIVIL, BENCH_GMTIME, BENCH_EPOCH, BENCH_TIMEGM };
+
+struct bench_slice {
+  pthread_t thread;
+  enum bench_method method;
+  int64_t *epochs, *back;
+  struct civil_time *civil;
+  struct tm *tms;
+  size_t n;
+};
+
+void printInfo(const char *name, long long *seconds, long long period);
+
+void printWraps(void);
+
+void epochToCivil(int64_t epoch, struct civil_time *civil);
+void epochToCivilBatch(const int64_t *epochs, struct civil_time *civil, size_t n);
+int64_t civilToEpoch(const struct civil_time *civil);
+void civilToEpochBatch(const struct civil_time *civil, int64_t *epochs, size_t n);
+size_t formatCivil(const struct civil_time *civil, char *buf);
+
+static int convert(FILE *in, int binary, long nthreads);
+static size_t readBinary(FILE *in, int64_t *epochs, size_t n);
+static size_t readText(FILE *in, int64_t *epochs, size_t n, long *line);
+static void *convertSlice(void *arg);
+static void formatInstant(const struct instant *in, int digits, char *buf, size_t len);
+static int benchmark(long n, long nthreads);
+static void *benchSlice(void *arg);
+static double timeSlices(struct bench_slice *slices, long nthreads, int method);
+static void helpAndLeave(int status);
 
 int
-main() {
+main(int argc, char *argv[]) {
   time_t time_t_wrap, currtime;
-  struct tm *utc_time;
-  double diff;
+  struct civil_time utc_time;
+  long long diff;
+  long nthreads = 1, values = 0;
+  int opt, binary = 0, bulk = 0;
+  FILE *in = stdin;
+
+  while ((opt = getopt(argc, argv, "bcj:t:")) != -1) {
+    switch (opt) {
+      case 'b':
+        binary = 1;
+        break;
+      case 'c':
+        bulk = 1;
+        break;
+      case 'j':
+        nthreads = strtol(optarg, NULL, 10);
+        break;
+      case 't':
+        values = strtol(optarg, NULL, 10);
+        if (values <= 0)
+          helpAndLeave(EXIT_FAILURE);
+        break;
+      default:
+        helpAndLeave(EXIT_FAILURE);
+    }
+  }
+
+  if (nthreads <= 0 || nthreads > MAXTHREADS || (!bulk && (binary || optind < argc)) || optind + 1 < argc ||
+      (bulk && values > 0))
+    helpAndLeave(EXIT_FAILURE);
+
+  if (values > 0)
+    exit(benchmark(values, nthreads) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+  if (bulk) {
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+      perror("fopen");
+      exit(EXIT_FAILURE);
+    }
+
+    exit(convert(in, binary, nthreads) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
 
   /* time_t can be defined in multiple ways according to the platform. The
    * standard even states that it can be stored as an integer or a floating point
@@ -43,15 +245,13 @@ main() {
    * /usr/include/time.h */
   time_t_wrap = INT_MAX;
 
-  /* use gmtime(2) in order to retrieve time in UTC, instead of relying on local time,
-   * which may vary depending on the system this program is run */
-  utc_time = gmtime(&time_t_wrap);
-  if (utc_time == NULL) {
-    perror("gmtime");
-    exit(EXIT_FAILURE);
-  }
+  /* the date is computed in UTC, instead of relying on local time, which may
+   * vary depending on the system this program is run */
+  epochToCivil(time_t_wrap, &utc_time);
 
-  printf("UNIX Demon will hunt you until %s", asctime(utc_time));
+  printf("UNIX Demon will hunt you until %s %s %2d %02d:%02d:%02d %lld\n",
+      weekdays[utc_time.weekday], months[utc_time.month - 1], utc_time.day,
+      utc_time.hour, utc_time.minute, utc_time.second, (long long) utc_time.year);
 
   currtime = time(NULL);
   if (currtime == -1) {
@@ -59,7 +259,7 @@ main() {
     exit(EXIT_FAILURE);
   }
 
-  diff = difftime(time_t_wrap, currtime);
+  diff = (long long) time_t_wrap - currtime;
   printf("That is, ");
   printInfo("years",   &diff, YEAR);
   printInfo("months",  &diff, MONTH);
@@ -69,22 +269,476 @@ main() {
   printInfo("minutes", &diff, MINUTE);
 
   if (diff > 0) {
-    printf("and %d seconds.", (int) diff);
+    printf("and %lld seconds.", diff);
   }
 
-  printf("\n");
+  printf("\n\n");
+  printWraps();
 
   exit(EXIT_SUCCESS);
 }
 
+/* lists the range of dates of every timestamp format */
 void
-printInfo(const char *name, double *seconds, int period) {
-  int n;
+printWraps(void) {
+  char earliest[64], latest[64];
+  size_t i;
+
+  printf("%-7s %-5s %-36s %s\n", "type", "unit", "earliest", "latest");
+
+  for (i = 0; i < sizeof(wraps) / sizeof(wraps[0]); ++i) {
+    formatInstant(&wraps[i].earliest, wraps[i].digits, earliest, sizeof(earliest));
+    formatInstant(&wraps[i].latest, wraps[i].digits, latest, sizeof(latest));
+
+    printf("%-7s %-5s %-36s %s\n", wraps[i].type, wraps[i].unit, earliest, latest);
+  }
+}
+
+static void
+formatInstant(const struct instant *in, int digits, char *buf, size_t len) {
+  if (digits == 0) {
+    snprintf(buf, len, "%lld-%02d-%02dT%02d:%02d:%02dZ", (long long) in->year, in->month, in->day,
+        in->hour, in->minute, in->second);
+  } else {
+    snprintf(buf, len, "%lld-%02d-%02dT%02d:%02d:%02d.%0*lldZ", (long long) in->year, in->month, in->day,
+        in->hour, in->minute, in->second, digits, (long long) in->fraction);
+  }
+}
+
+void
+printInfo(const char *name, long long *seconds, long long period) {
+  long long n;
 
   n = *seconds / period;
   if (n > 0) {
-    printf("%d %s, ", n, name);
+    printf("%lld %s, ", n, name);
   }
 
   *seconds -= period * n;
 }
+
+/* converts a single timestamp. Safe to call from any number of threads. */
+void
+epochToCivil(int64_t epoch, struct civil_time *civil) {
+  epochToCivilBatch(&epoch, civil, 1);
+}
+
+/* converts `n` timestamps. Divisions are rounded towards minus infinity by
+ * correcting the truncated quotient with the sign of the remainder, and the
+ * month is picked arithmetically, so that the loop has no branches for the
+ * compiler to give up vectorizing on. */
+void
+epochToCivilBatch(const int64_t *epochs, struct civil_time *civil, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    int64_t days = epochs[i] / DAY, secs = epochs[i] % DAY;
+    int64_t neg = secs < 0;
+
+    days -= neg;
+    secs += neg * DAY;
+
+    /* days since 0000-03-01, split into 400-year eras of 146097 days: years
+     * start in March, so that leap days are the last day of a year */
+    int64_t z = days + 719468;
+    int64_t era = (z - (z < 0) * 146096) / 146097;
+    int64_t doe = z - era * 146097;                                     /* [0, 146096] */
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; /* [0, 399] */
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);              /* [0, 365] */
+    int64_t mp = (5 * doy + 2) / 153;                                   /* [0, 11], from March */
+    int64_t month = mp + 3 - 12 * (mp >= 10);
+    int64_t year = yoe + era * 400 + (month <= 2);
+    int64_t leap = (year % 4 == 0) & ((year % 100 != 0) | (year % 400 == 0));
+    int64_t wday = (days + 4) % 7; /* 1970-01-01 was a Thursday */
+
+    civil[i].year = year;
+    civil[i].month = month;
+    civil[i].day = doy - (153 * mp + 2) / 5 + 1;
+    civil[i].hour = secs / HOUR;
+    civil[i].minute = secs % HOUR / MINUTE;
+    civil[i].second = secs % MINUTE;
+    civil[i].weekday = wday + 7 * (wday < 0);
+    civil[i].yearday = (mp >= 10) * (doy - 306) + (mp < 10) * (doy + 59 + leap);
+  }
+}
+
+/* converts a broken down time back to a timestamp, the way timegm(3) does,
+ * but without normalizing out of range fields. Safe to call from any number
+ * of threads. */
+int64_t
+civilToEpoch(const struct civil_time *civil) {
+  int64_t epoch;
+
+  civilToEpochBatch(civil, &epoch, 1);
+  return epoch;
+}
+
+/* the inverse of `epochToCivilBatch`: days are counted from 0000-03-01, in
+ * eras of 400 years */
+void
+civilToEpochBatch(const struct civil_time *civil, int64_t *epochs, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    int64_t y = civil[i].year - (civil[i].month <= 2);
+    int64_t era = FDIV(y, 400);
+    int64_t yoe = y - era * 400;                                     /* [0, 399] */
+    int64_t mp = civil[i].month - 3 + 12 * (civil[i].month <= 2);  /* [0, 11], from March */
+    int64_t doy = (153 * mp + 2) / 5 + civil[i].day - 1;            /* [0, 365] */
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;            /* [0, 146096] */
+    int64_t days = era * 146097 + doe - 719468;
+
+    epochs[i] = days * DAY + civil[i].hour * HOUR + civil[i].minute * MINUTE + civil[i].second;
+  }
+}
+
+/* writes the time as an ISO 8601 date, followed by a new line, to `buf`
+ * (DATE_LEN bytes long). Returns the number of bytes written. */
+size_t
+formatCivil(const struct civil_time *civil, char *buf) {
+  int64_t y = civil->year;
+  char *p = buf;
+
+  /* years beyond four digits are rare enough for printf */
+  if (y < 0 || y > 9999)
+    return snprintf(buf, DATE_LEN, "%lld-%02d-%02dT%02d:%02d:%02dZ\n", (long long) y,
+        civil->month, civil->day, civil->hour, civil->minute, civil->second);
+
+  *p++ = '0' + y / 1000;
+  *p++ = '0' + y / 100 % 10;
+  *p++ = '0' + y / 10 % 10;
+  *p++ = '0' + y % 10;
+  *p++ = '-';
+  *p++ = '0' + civil->month / 10;
+  *p++ = '0' + civil->month % 10;
+  *p++ = '-';
+  *p++ = '0' + civil->day / 10;
+  *p++ = '0' + civil->day % 10;
+  *p++ = 'T';
+  *p++ = '0' + civil->hour / 10;
+  *p++ = '0' + civil->hour % 10;
+  *p++ = ':';
+  *p++ = '0' + civil->minute / 10;
+  *p++ = '0' + civil->minute % 10;
+  *p++ = ':';
+  *p++ = '0' + civil->second / 10;
+  *p++ = '0' + civil->second % 10;
+  *p++ = 'Z';
+  *p++ = '\n';
+
+  return p - buf;
+}
+
+/* converts every timestamp in `in`, a batch at a time. Each batch is split
+ * in one slice per thread, and slices are written in order. */
+static int
+convert(FILE *in, int binary, long nthreads) {
+  struct slice slices[MAXTHREADS];
+  struct civil_time *civil;
+  int64_t *epochs;
+  char *out;
+  size_t n, per, off;
+  long i, line = 0;
+  int s;
+
+  epochs = malloc(BATCH * sizeof(int64_t));
+  civil = malloc(BATCH * sizeof(struct civil_time));
+  out = malloc((size_t) BATCH * DATE_LEN);
+  if (epochs == NULL || civil == NULL || out == NULL) {
+    perror("malloc");
+    return -1;
+  }
+
+  for (;;) {
+    n = binary ? readBinary(in, epochs, BATCH) : readText(in, epochs, BATCH, &line);
+    if (n == (size_t) -1) {
+      fprintf(stderr, "time_t_wrap: line %ld: invalid timestamp\n", line);
+      return -1;
+    }
+
+    if (n == 0)
+      break;
+
+    per = (n + nthreads - 1) / nthreads;
+    for (i = 0, off = 0; i < nthreads; ++i, off += per) {
+      slices[i].epochs = &epochs[off < n ? off : n];
+      slices[i].n = off < n ? (n - off < per ? n - off : per) : 0;
+      slices[i].civil = &civil[off < n ? off : n];
+      slices[i].out = &out[(off < n ? off : n) * DATE_LEN];
+    }
+
+    /* small batches (and single threaded runs) are not worth a thread */
+    if (nthreads == 1 || n < BATCH / 4) {
+      for (i = 0; i < nthreads; ++i)
+        convertSlice(&slices[i]);
+    } else {
+      for (i = 0; i < nthreads; ++i) {
+        if ((s = pthread_create(&slices[i].thread, NULL, convertSlice, &slices[i])) != 0) {
+          fprintf(stderr, "pthread_create: %s\n", strerror(s));
+          return -1;
+        }
+      }
+
+      for (i = 0; i < nthreads; ++i)
+        pthread_join(slices[i].thread, NULL);
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+      if (fwrite(slices[i].out, 1, slices[i].outlen, stdout) != slices[i].outlen) {
+        perror("fwrite");
+        return -1;
+      }
+    }
+  }
+
+  if (ferror(in)) {
+    perror("fread");
+    return -1;
+  }
+
+  free(epochs);
+  free(civil);
+  free(out);
+
+  return fflush(stdout) == EOF ? -1 : 0;
+}
+
+static void *
+convertSlice(void *arg) {
+  struct slice *s = arg;
+  size_t i;
+
+  epochToCivilBatch(s->epochs, s->civil, s->n);
+
+  s->outlen = 0;
+  for (i = 0; i < s->n; ++i)
+    s->outlen += formatCivil(&s->civil[i], &s->out[s->outlen]);
+
+  return NULL;
+}
+
+/* reads up to `n` native 64-bit timestamps. A truncated last record is
+ * ignored. */
+static size_t
+readBinary(FILE *in, int64_t *epochs, size_t n) {
+  return fread(epochs, sizeof(int64_t), n, in);
+}
+
+/* reads up to `n` decimal timestamps, one per line (blank lines are
+ * skipped), and counts the lines read in `line`. Returns -1 if a line does
+ * not hold a 64-bit integer. */
+static size_t
+readText(FILE *in, int64_t *epochs, size_t n, long *line) {
+  char buf[64];
+  size_t count = 0, len;
+  uint64_t value, limit;
+  char *p;
+  int negative;
+
+  while (count < n && fgets(buf, sizeof(buf), in) != NULL) {
+    ++*line;
+
+    len = strlen(buf);
+    if (len == sizeof(buf) - 1 && buf[len - 1] != '\n')
+      return -1;
+
+    p = buf;
+    while (*p == ' ' || *p == '\t')
+      ++p;
+
+    if (*p == '\n' || *p == '\r' || *p == '\0')
+      continue;
+
+    negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+      ++p;
+
+    /* INT64_MIN has no positive counterpart */
+    limit = negative ? (uint64_t) INT64_MAX + 1 : (uint64_t) INT64_MAX;
+    if (*p < '0' || *p > '9')
+      return -1;
+
+    for (value = 0; *p >= '0' && *p <= '9'; ++p) {
+      if (value > (limit - (*p - '0')) / 10)
+        return -1;
+      value = value * 10 + (*p - '0');
+    }
+
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      ++p;
+    if (*p != '\0')
+      return -1;
+
+    epochs[count++] = negative ? (int64_t) (0 - value) : (int64_t) value;
+  }
+
+  return count;
+}
+
+/* ranges the conversions are checked on. gmtime_r(3) gives up on years that
+ * do not fit an int, a little after the 2 billionth. */
+static const struct {
+  const char *name;
+  int64_t lo, hi;
+} ranges[] = {
+  { "int32",  INT32_MIN, INT32_MAX },
+  { "uint32", 0, UINT32_MAX },
+  { "0-9999", INT64_C(-62167219200), INT64_C(253402300799) },
+  { "int64",  INT64_C(-60000000000000000), INT64_C(60000000000000000) },
+};
+
+/* converts `n` random timestamps of each range both ways, with this program
+ * and with libc, and reports any disagreement and the time each took (per
+ * timestamp, over all threads). */
+static int
+benchmark(long n, long nthreads) {
+  struct bench_slice slices[MAXTHREADS];
+  struct civil_time *civil;
+  struct tm *tms;
+  int64_t *epochs, *back;
+  uint64_t x = 88172645463325252ULL; /* xorshift64 state */
+  double civil_time, gmtime_time, epoch_time, timegm_time;
+  long i, per, mismatches, failures = 0;
+  size_t r;
+
+  epochs = malloc(n * sizeof(int64_t));
+  back = malloc(n * sizeof(int64_t));
+  civil = malloc(n * sizeof(struct civil_time));
+  tms = malloc(n * sizeof(struct tm));
+  if (epochs == NULL || back == NULL || civil == NULL || tms == NULL) {
+    perror("malloc");
+    return -1;
+  }
+
+  /* page faults would be charged to whatever runs first */
+  memset(back, 0, n * sizeof(int64_t));
+  memset(civil, 0, n * sizeof(struct civil_time));
+  memset(tms, 0, n * sizeof(struct tm));
+
+  per = (n + nthreads - 1) / nthreads;
+  for (i = 0; i < nthreads; ++i) {
+    slices[i].epochs = &epochs[i * per < n ? i * per : n];
+    slices[i].back = &back[i * per < n ? i * per : n];
+    slices[i].civil = &civil[i * per < n ? i * per : n];
+    slices[i].tms = &tms[i * per < n ? i * per : n];
+    slices[i].n = i * per < n ? (n - i * per < per ? n - i * per : per) : 0;
+  }
+
+  printf("%-7s %10s %10s %10s %10s %8s %10s %10s %8s\n", "range", "values", "mismatch",
+      "civil_ns", "gmtime_ns", "speedup", "epoch_ns", "timegm_ns", "speedup");
+
+  for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+    for (i = 0; i < n; ++i) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      epochs[i] = ranges[r].lo + (int64_t) (x % ((uint64_t) ranges[r].hi - ranges[r].lo + 1));
+    }
+
+    civil_time = timeSlices(slices, nthreads, BENCH_CIVIL);
+    gmtime_time = timeSlices(slices, nthreads, BENCH_GMTIME);
+
+    mismatches = 0;
+    for (i = 0; i < n; ++i) {
+      if (civil[i].year != tms[i].tm_year + INT64_C(1900) || civil[i].month != tms[i].tm_mon + 1 ||
+          civil[i].day != tms[i].tm_mday || civil[i].hour != tms[i].tm_hour ||
+          civil[i].minute != tms[i].tm_min || civil[i].second != tms[i].tm_sec ||
+          civil[i].weekday != tms[i].tm_wday || civil[i].yearday != tms[i].tm_yday)
+        ++mismatches;
+    }
+
+    /* both ways back must land on the original timestamps */
+    epoch_time = timeSlices(slices, nthreads, BENCH_EPOCH);
+    for (i = 0; i < n; ++i)
+      mismatches += back[i] != epochs[i];
+
+    timegm_time = timeSlices(slices, nthreads, BENCH_TIMEGM);
+    for (i = 0; i < n; ++i)
+      mismatches += back[i] != epochs[i];
+
+    printf("%-7s %10ld %10ld %10.2f %10.2f %7.1fx %10.2f %10.2f %7.1fx\n", ranges[r].name, n, mismatches,
+        civil_time * 1e9 / n, gmtime_time * 1e9 / n, gmtime_time / civil_time,
+        epoch_time * 1e9 / n, timegm_time * 1e9 / n, timegm_time / epoch_time);
+
+    failures += mismatches;
+  }
+
+  free(epochs);
+  free(back);
+  free(civil);
+  free(tms);
+
+  if (failures > 0) {
+    fprintf(stderr, "time_t_wrap: %ld conversions disagree with libc\n", failures);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* runs `method` on every slice, with a thread each (unless there is only
+ * one), and returns the time it took */
+static double
+timeSlices(struct bench_slice *slices, long nthreads, int method) {
+  struct timespec start, end;
+  long i;
+  int s;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (nthreads == 1) {
+    slices[0].method = method;
+    benchSlice(&slices[0]);
+  } else {
+    for (i = 0; i < nthreads; ++i) {
+      slices[i].method = method;
+      if ((s = pthread_create(&slices[i].thread, NULL, benchSlice, &slices[i])) != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(s));
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    for (i = 0; i < nthreads; ++i)
+      pthread_join(slices[i].thread, NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void *
+benchSlice(void *arg) {
+  struct bench_slice *s = arg;
+  time_t t;
+  size_t i;
+
+  switch (s->method) {
+    case BENCH_CIVIL:
+      epochToCivilBatch(s->epochs, s->civil, s->n);
+      break;
+    case BENCH_GMTIME:
+      for (i = 0; i < s->n; ++i) {
+        t = s->epochs[i];
+        if (gmtime_r(&t, &s->tms[i]) == NULL)
+          memset(&s->tms[i], 0, sizeof(struct tm));
+      }
+      break;
+    case BENCH_EPOCH:
+      civilToEpochBatch(s->civil, s->back, s->n);
+      break;
+    case BENCH_TIMEGM:
+      for (i = 0; i < s->n; ++i)
+        s->back[i] = timegm(&s->tms[i]);
+      break;
+  }
+
+  return NULL;
+}
+
+static void
+helpAndLeave(int status) {
+  FILE *stream = status == EXIT_SUCCESS ? stdout : stderr;
+
+  fprintf(stream, "Usage: time_t_wrap [-c [-b] [-j <threads>] [<file>] | -t <values> [-j <threads>]]\n");
+  exit(status);
+}